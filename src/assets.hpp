@@ -0,0 +1,386 @@
+// assets.hpp
+#pragma once
+
+#include "sdl.hpp"
+#include <string>
+#include <string_view>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+#if defined(_WIN32)
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#elif defined(__unix__) || defined(__APPLE__)
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+// Read-only asset bytes handed to SDL_ttf and SDL_image as SDL_IOFromConstMem streams, so a
+// font or image is never copied out of the page cache and every user of a file shares one map.
+//     assets::Source source;
+//     source.mount("totpad.pak");
+//     auto texture = renderer.loadTexture(source.open("icon.png"));
+//     fonts.setLoader(source.fontLoader());
+// Bundles are written by src/pack.cpp.
+namespace assets {
+
+    // A whole file mapped read-only. Falls back to SDL_LoadFile where there is no mmap.
+    class Mapping {
+        public:
+        explicit Mapping(const std::string& path) {
+#if defined(_WIN32)
+            const int length = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0);
+            std::wstring wide(length > 0 ? length : 1, L'\0');
+            MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, wide.data(), length);
+            HANDLE file = CreateFileW(wide.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE) fail(path);
+            LARGE_INTEGER bytes;
+            if (!GetFileSizeEx(file, &bytes)) {
+                CloseHandle(file);
+                fail(path);
+            }
+            _size = static_cast<size_t>(bytes.QuadPart);
+            if (_size) {
+                HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                if (mapping) {
+                    _data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                    CloseHandle(mapping);
+                }
+            }
+            CloseHandle(file);
+            if (_size && !_data) fail(path);
+#elif defined(__unix__) || defined(__APPLE__)
+            const int file = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (file < 0) fail(path);
+            struct stat info;
+            if (fstat(file, &info) != 0) {
+                ::close(file);
+                fail(path);
+            }
+            _size = static_cast<size_t>(info.st_size);
+            if (_size) {
+                void* data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, file, 0);
+                _data = data == MAP_FAILED ? nullptr : data;
+            }
+            ::close(file);
+            if (_size && !_data) fail(path);
+#else
+            _data = SDL_LoadFile(path.c_str(), &_size);
+            if (!_data) throw_error;
+#endif
+        }
+        Mapping(const Mapping&) = delete;
+        Mapping& operator=(const Mapping&) = delete;
+        Mapping(Mapping&& other): _data(other._data), _size(other._size) {
+            other._data = nullptr;
+            other._size = 0;
+        }
+        Mapping& operator=(Mapping&& other) {
+            if (this != &other) {
+                unmap();
+                _data = other._data;
+                _size = other._size;
+                other._data = nullptr;
+                other._size = 0;
+            }
+            return *this;
+        }
+        ~Mapping() {
+            unmap();
+        }
+        const char* data() const { return static_cast<const char*>(_data ? _data : ""); }
+        size_t size() const { return _size; }
+        private:
+        void* _data = nullptr;
+        size_t _size = 0;
+        void unmap() {
+            if (!_data) return;
+#if defined(_WIN32)
+            UnmapViewOfFile(_data);
+#elif defined(__unix__) || defined(__APPLE__)
+            munmap(_data, _size);
+#else
+            SDL_free(_data);
+#endif
+            _data = nullptr;
+        }
+        [[noreturn]] static void fail(const std::string& path) {
+            SDL_SetError("Could not map %s", path.c_str());
+            throw_error;
+        }
+    };
+
+    // Bundle layout, little endian:
+    //     Header   at 0
+    //     Entry[]  at Header::toc, sorted by name
+    //     names    at Header::names, not terminated
+    //     data     every entry starts on an `alignment` boundary
+    // `size` is the decoded size and `stored` the size inside the bundle; `hash` is the FNV-1a
+    // of the decoded bytes, 0 when not recorded.
+    namespace bundle {
+        inline constexpr char magic[4] = {'T', 'P', 'A', 'K'};
+        inline constexpr uint32_t version = 1;
+        inline constexpr uint64_t alignment = 16;
+        enum Compression : uint8_t { Stored = 0, LZ4 = 1 };
+        // An LZ4 block can't expand by more than this: a match is at most 255 bytes longer per
+        // extra length byte. Also caps what a corrupt header can make read() allocate.
+        inline constexpr uint64_t max_lz4_ratio = 255;
+        struct Header {
+            char magic[4];
+            uint32_t version;
+            uint32_t count;
+            uint32_t flags;
+            uint64_t toc;
+            uint64_t names;
+        };
+        struct Entry {
+            uint64_t offset;
+            uint64_t size;
+            uint64_t stored;
+            uint64_t hash;
+            uint32_t name;
+            uint16_t name_length;
+            uint8_t compression;
+            uint8_t reserved;
+        };
+        static_assert(sizeof(Header) == 32 && sizeof(Entry) == 40, "bundle layout");
+
+        inline uint64_t fnv1a(const void* data, size_t size) {
+            auto bytes = static_cast<const unsigned char*>(data);
+            uint64_t hash = 0xCBF29CE484222325ull;
+            for (size_t i = 0; i < size; i++) {
+                hash ^= bytes[i];
+                hash *= 0x100000001B3ull;
+            }
+            return hash;
+        }
+
+        // Decodes one LZ4 block (no frame header) that must fill `destination` exactly.
+        inline bool decompress(const char* source, size_t size, char* destination, size_t capacity) {
+            auto in = reinterpret_cast<const unsigned char*>(source);
+            auto in_end = in + size;
+            char* out = destination;
+            char* out_end = destination + capacity;
+            auto length = [&](size_t value, size_t& result) {
+                if (value == 15) {
+                    unsigned char byte;
+                    do {
+                        if (in == in_end) return false;
+                        byte = *in++;
+                        value += byte;
+                    } while (byte == 255);
+                }
+                result = value;
+                return true;
+            };
+            while (in < in_end) {
+                const unsigned char token = *in++;
+                size_t literals, match;
+                if (!length(token >> 4, literals)) return false;
+                if (literals > static_cast<size_t>(in_end - in) || literals > static_cast<size_t>(out_end - out)) return false;
+                if (literals) std::memcpy(out, in, literals);
+                in += literals;
+                out += literals;
+                // The last sequence has literals only.
+                if (in == in_end) break;
+                if (in_end - in < 2) return false;
+                const size_t offset = in[0] | in[1] << 8;
+                in += 2;
+                if (offset == 0 || offset > static_cast<size_t>(out - destination)) return false;
+                if (!length(token & 15, match)) return false;
+                match += 4;
+                if (match > static_cast<size_t>(out_end - out)) return false;
+                const char* from = out - offset;
+                if (offset >= match) std::memcpy(out, from, match);
+                else for (size_t i = 0; i < match; i++) out[i] = from[i];
+                out += match;
+            }
+            return out == out_end;
+        }
+    }
+
+    // Read view of one mapped bundle. The table of contents is validated once on open and
+    // looked up by binary search; entry bytes point straight into the mapping.
+    class Bundle {
+        public:
+        explicit Bundle(const std::string& path): mapping(path) {
+            if (mapping.size() < sizeof(bundle::Header)) invalid(path);
+            std::memcpy(&header, mapping.data(), sizeof(header));
+            header.version = SDL_Swap32LE(header.version);
+            header.count = SDL_Swap32LE(header.count);
+            header.toc = SDL_Swap64LE(header.toc);
+            header.names = SDL_Swap64LE(header.names);
+            if (std::memcmp(header.magic, bundle::magic, 4) != 0 || header.version != bundle::version) invalid(path);
+            if (header.toc > mapping.size() || header.count > (mapping.size() - header.toc) / sizeof(bundle::Entry)) invalid(path);
+            if (header.names > mapping.size()) invalid(path);
+            entries.resize(header.count);
+            for (uint32_t i = 0; i < header.count; i++) {
+                auto& entry = entries[i];
+                std::memcpy(&entry, mapping.data() + header.toc + i * sizeof(bundle::Entry), sizeof(entry));
+                entry.offset = SDL_Swap64LE(entry.offset);
+                entry.size = SDL_Swap64LE(entry.size);
+                entry.stored = SDL_Swap64LE(entry.stored);
+                entry.hash = SDL_Swap64LE(entry.hash);
+                entry.name = SDL_Swap32LE(entry.name);
+                entry.name_length = SDL_Swap16LE(entry.name_length);
+                if (entry.offset > mapping.size() || entry.stored > mapping.size() - entry.offset) invalid(path);
+                // Stored entries are handed out as spans of `size` bytes, so they must lie in the mapping too.
+                if (entry.compression == bundle::Stored && entry.size != entry.stored) invalid(path);
+                else if (entry.compression == bundle::LZ4 && entry.size / bundle::max_lz4_ratio > entry.stored) invalid(path);
+                else if (entry.compression != bundle::Stored && entry.compression != bundle::LZ4) invalid(path);
+                if (entry.name > mapping.size() - header.names || entry.name_length > mapping.size() - header.names - entry.name) invalid(path);
+                if (i && !(name(entries[i - 1]) < name(entry))) invalid(path);
+            }
+        }
+        size_t size() const { return entries.size(); }
+        std::string_view name(size_t index) const { return name(entries[index]); }
+        // Index of `file`, or size() when the bundle does not contain it.
+        size_t find(std::string_view file) const {
+            auto found = std::lower_bound(entries.begin(), entries.end(), file,
+                [this](const bundle::Entry& entry, std::string_view key) { return name(entry) < key; });
+            if (found == entries.end() || name(*found) != file) return entries.size();
+            return static_cast<size_t>(found - entries.begin());
+        }
+        const bundle::Entry& entry(size_t index) const { return entries[index]; }
+        bool stored(size_t index) const { return entries[index].compression == bundle::Stored; }
+        // Bytes of a stored entry inside the mapping.
+        const char* data(size_t index) const {
+            if (!stored(index)) {
+                SDL_SetError("Bundle entry is compressed");
+                throw_error;
+            }
+            return mapping.data() + entries[index].offset;
+        }
+        // Decoded copy of any entry, checked against its hash.
+        std::vector<char> read(size_t index) const {
+            const auto& e = entries[index];
+            std::vector<char> out(e.size);
+            const char* in = mapping.data() + e.offset;
+            if (e.compression == bundle::Stored) {
+                if (e.stored != e.size) corrupt(index);
+                if (e.size) std::memcpy(out.data(), in, e.size);
+            }
+            else if (e.compression == bundle::LZ4) {
+                if (!bundle::decompress(in, e.stored, out.data(), out.size())) corrupt(index);
+            }
+            else {
+                SDL_SetError("Unsupported compression in bundle entry %.*s", static_cast<int>(e.name_length), name(e).data());
+                throw_error;
+            }
+            if (e.hash && bundle::fnv1a(out.data(), out.size()) != e.hash) corrupt(index);
+            return out;
+        }
+        // Hashes the bytes of a stored entry. Not done on lookup, which would fault in the whole map.
+        bool verify(size_t index) const {
+            if (!stored(index)) {
+                try {
+                    read(index);
+                    return true;
+                } catch (const std::exception&) {
+                    return false;
+                }
+            }
+            const auto& e = entries[index];
+            return e.stored == e.size && (!e.hash || bundle::fnv1a(mapping.data() + e.offset, e.size) == e.hash);
+        }
+        private:
+        Mapping mapping;
+        bundle::Header header;
+        std::vector<bundle::Entry> entries;
+        std::string_view name(const bundle::Entry& entry) const {
+            return std::string_view(mapping.data() + header.names + entry.name, entry.name_length);
+        }
+        [[noreturn]] static void invalid(const std::string& path) {
+            SDL_SetError("Invalid asset bundle %s", path.c_str());
+            throw_error;
+        }
+        [[noreturn]] void corrupt(size_t index) const {
+            const auto file = name(entries[index]);
+            SDL_SetError("Corrupt bundle entry %.*s", static_cast<int>(file.size()), file.data());
+            throw_error;
+        }
+    };
+
+    // Resolves asset names against the mounted bundles, newest first, then loose files under
+    // `root`. Loose files are mapped once and stay mapped for the lifetime of the Source, and
+    // compressed bundle entries are decoded once and kept; streams and spans are valid as long
+    // as their owner (or the Source) lives. Thread safe.
+    class Source {
+        public:
+        struct Span {
+            const char* data = nullptr;
+            size_t size = 0;
+            std::shared_ptr<const void> owner;
+        };
+        explicit Source(std::string root = std::string()): root(std::move(root)) {}
+
+        // `path` relative to the root, unless it is absolute.
+        std::string resolve(const std::string& path) const {
+            const bool absolute = !path.empty() && (path[0] == '/' || path[0] == '\\' || (path.size() > 1 && path[1] == ':'));
+            if (root.empty() || absolute) return path;
+            const char last = root.back();
+            return last == '/' || last == '\\' ? root + path : root + "/" + path;
+        }
+        void mount(const std::string& path) {
+            auto bundle = std::make_shared<const Bundle>(resolve(path));
+            std::lock_guard<std::mutex> lock(mutex);
+            bundles.insert(bundles.begin(), std::move(bundle));
+        }
+        // Throws if `name` can't be found.
+        Span find(const std::string& name) {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto& bundle : bundles) {
+                const size_t index = bundle->find(name);
+                if (index >= bundle->size()) continue;
+                if (bundle->stored(index)) return Span{bundle->data(index), bundle->entry(index).size, bundle};
+                auto& bytes = decoded[name];
+                if (!bytes) bytes = std::make_shared<const std::vector<char>>(bundle->read(index));
+                return Span{bytes->data(), bytes->size(), bytes};
+            }
+            auto& mapping = files[name];
+            if (!mapping) mapping = std::make_shared<const Mapping>(resolve(name));
+            return Span{mapping->data(), mapping->size(), mapping};
+        }
+        // Zero-copy stream over `name`, or nullptr with the SDL error set.
+        SDL_IOStream* open(const std::string& name) {
+            try {
+                const Span span = find(name);
+                return SDL_IOFromConstMem(span.data, span.size);
+            } catch (const std::exception&) {
+                return nullptr;
+            }
+        }
+        // Points `config` at a stream over `name` that the opened font closes.
+        void bind(SDL::TTF::Font::Config& config, const std::string& name) {
+            static constexpr SDL::TTF::Font::Config::Key iostream{"iostream"}, autoclose{"iostream.autoclose"};
+            auto stream = open(name);
+            if (!stream) throw_error;
+            config.set(iostream, static_cast<void*>(stream));
+            config.set(autoclose, true);
+        }
+        SDL::TTF::FontCache::Loader fontLoader() {
+            return [this](const std::string& file) {
+                Span span = find(file);
+                return SDL::TTF::FontCache::Bytes{span.data, span.size, std::move(span.owner)};
+            };
+        }
+        private:
+        std::string root;
+        std::mutex mutex;
+        std::vector<std::shared_ptr<const Bundle>> bundles;
+        std::unordered_map<std::string, std::shared_ptr<const Mapping>> files;
+        std::unordered_map<std::string, std::shared_ptr<const std::vector<char>>> decoded;
+    };
+
+} // namespace assets
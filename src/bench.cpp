@@ -0,0 +1,357 @@
+#include "sdl.hpp"
+#include "document.hpp"
+#include "view.hpp"
+#include "simd.hpp"
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <cstdlib>
+#include <new>
+
+using RectF = math::Rectangle<float>;
+using math::Color;
+using math::d2::size;
+using math::d2::position;
+
+using std::cout, std::endl;
+
+// Headless benchmarks for the sdl.hpp wrappers and the Totpad hot paths.
+// Runs on the offscreen/dummy video driver with the software renderer, so no GPU or
+// display is needed, and prints one JSON document with per-benchmark percentiles.
+
+// Every operator new in the process is counted, so a benchmark can check that its steady
+// state stays off the heap. SDL's own mallocs are not.
+static std::atomic<uint64_t> allocations{0};
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size ? size : 1)) return memory;
+    throw std::bad_alloc();
+}
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, size_t) noexcept { std::free(memory); }
+
+struct Samples {
+    std::string name;
+    std::string unit = "ns";
+    std::vector<uint64_t> values;
+
+    void add(const uint64_t value) { values.push_back(value); }
+
+    uint64_t percentile(const double p) {
+        if (values.empty()) return 0;
+        std::sort(values.begin(), values.end());
+        size_t index = static_cast<size_t>(p * (values.size() - 1) + 0.5);
+        return values[index];
+    }
+    void print(std::ostream& out) {
+        uint64_t total = 0;
+        for (auto value : values) total += value;
+        out << "    {\"name\": \"" << name << "\", \"unit\": \"" << unit << "\""
+            << ", \"samples\": " << values.size()
+            << ", \"mean\": " << (values.empty() ? 0 : total / values.size())
+            << ", \"p50\": " << percentile(0.50)
+            << ", \"p90\": " << percentile(0.90)
+            << ", \"p99\": " << percentile(0.99)
+            << ", \"max\": " << percentile(1.0) << "}";
+    }
+};
+
+template<typename Task>
+inline void measure(Samples& samples, const int iterations, Task&& task) {
+    for (int i = 0; i < iterations; i++) {
+        auto start = SDL_GetTicksNS();
+        task(i);
+        samples.add(SDL_GetTicksNS() - start);
+    }
+}
+
+inline std::string filler(const size_t bytes) {
+    static const char line[] = "The quick brown fox jumps over the lazy dog 0123456789\n";
+    std::string str;
+    str.reserve(bytes);
+    while (str.size() < bytes) str.append(line, std::min(sizeof(line) - 1, bytes - str.size()));
+    return str;
+}
+
+// Returns false when a check failed.
+inline bool bench(std::vector<Samples>& results, const char* font_file) {
+    bool passed = true;
+    SDL_SetHint(SDL_HINT_VIDEO_DRIVER, "offscreen,dummy");
+    SDL sdl;
+    auto events = sdl.initEvents();
+    auto ttf = sdl.initTTF();
+    auto video = sdl.initVideo();
+
+    const size<int> viewport{1280, 720};
+    auto window = video.createWindow("Totpad bench", viewport, SDL_WINDOW_HIDDEN);
+    auto renderer = window.createRenderer("software");
+    auto font = ttf.loadFont(font_file, 16.0f);
+    auto text_engine = renderer.createTextEngine();
+
+    // Typing: one keystroke through Document, TextView and a damaged frame, per document size.
+    for (size_t bytes : {size_t(1) << 10, size_t(1) << 20, size_t(16) << 20}) {
+        auto document = totpad::Document(filler(bytes));
+        auto view = totpad::TextView(text_engine, font, document);
+        view.resize(viewport);
+        view.moveCaret(document.size() / 2);
+        Samples samples;
+        samples.name = "typing/" + std::to_string(bytes >> 10) + "KiB";
+        measure(samples, 500, [&](int) {
+            auto caret = view.caret();
+            auto line = document.lineOf(caret);
+            document.insert(caret, "x");
+            view.edited(line, 1, 1, caret + 1);
+            renderer.damage(view.damage(position<float>{0, 0}));
+            if (renderer.beginFrame(Color{0, 0, 0, 255})) {
+                view.draw(position<float>{0, 0});
+                renderer.endFrame();
+            }
+        });
+        results.push_back(std::move(samples));
+    }
+
+    // Rewrap: the visible window is relaid out for a new wrap width.
+    {
+        auto document = totpad::Document(filler(size_t(1) << 20));
+        auto view = totpad::TextView(text_engine, font, document);
+        view.resize(viewport);
+        Samples samples;
+        samples.name = "layout/rewrap";
+        measure(samples, 200, [&](int i) {
+            view.resize(size<int>{viewport.width - (i % 2) * 300, viewport.height});
+            view.damage(position<float>{0, 0});
+        });
+        results.push_back(std::move(samples));
+    }
+
+    // Full document view drawn through the glyph atlas: a screen of wrapped text must cost one
+    // draw call per atlas page, not one per paragraph. Samples are draw calls per frame.
+    {
+        auto document = totpad::Document(filler(size_t(1) << 20));
+        auto view = totpad::TextView(text_engine, font, document);
+        view.resize(viewport);
+        auto glyph_atlas = renderer.createGlyphAtlas();
+        Samples samples;
+        samples.name = "glyphAtlas/documentView";
+        samples.unit = "draws";
+        bool batched = true;
+        for (int i = 0; i < 50; i++) {
+            view.scroll(static_cast<float>(i % 2 ? -font.lineSkip() : font.lineSkip()));
+            renderer.damageAll();
+            if (!renderer.beginFrame(Color{0, 0, 0, 255})) continue;
+            view.draw(position<float>{0, 0}, glyph_atlas);
+            glyph_atlas.flush();
+            renderer.endFrame();
+            const auto stats = glyph_atlas.stats();
+            samples.add(stats.draw_calls);
+            if (stats.draw_calls > stats.pages) batched = false;
+        }
+        if (!batched) {
+            std::cerr << "Document view took up to " << samples.percentile(1.0) << " draw calls" << endl;
+            passed = false;
+        }
+        results.push_back(std::move(samples));
+    }
+
+    // Text scanning kernels over 16 MiB, the work the Loader does per chunk. Samples are MB/s.
+    {
+        const std::string text = filler(size_t(16) << 20);
+        const size_t lines = simd::count(text.data(), text.size());
+        std::vector<size_t> offsets;
+        offsets.reserve(lines);
+        auto throughput = [&](const char* name, auto&& task) {
+            Samples samples;
+            samples.name = name;
+            samples.unit = "MB/s";
+            for (int i = 0; i < 20; i++) {
+                const uint64_t start = SDL_GetTicksNS();
+                if (!task()) passed = false;
+                samples.add(text.size() * 1000 / std::max<uint64_t>(SDL_GetTicksNS() - start, 1));
+            }
+            results.push_back(std::move(samples));
+        };
+        throughput("simd/count16MiB", [&] {
+            return simd::count(text.data(), text.size()) == lines;
+        });
+        throughput("simd/index16MiB", [&] {
+            offsets.clear();
+            simd::index(text.data(), text.size(), 0, offsets);
+            return offsets.size() == lines;
+        });
+        throughput("simd/validate16MiB", [&] {
+            return simd::validate(text.data(), text.size());
+        });
+    }
+
+    // Rect throughput: 10k cells per frame, immediate fillRect against one DrawList. Each
+    // iteration flushes the renderer, so these time the drawing and not just the queueing.
+    const int cells = 10000;
+    auto cell = [&](int i) {
+        return RectF((i % 100) * 12.0f, (i / 100) * 7.0f, 10.0f, 5.0f);
+    };
+    {
+        Samples samples;
+        samples.name = "fillRect/10k";
+        measure(samples, 50, [&](int) {
+            for (int i = 0; i < cells; i++) renderer.fillRect(Color(i, i >> 8, 128, 255), cell(i));
+            renderer.flush();
+        });
+        results.push_back(std::move(samples));
+    }
+    {
+        auto draw_list = renderer.createDrawList();
+        draw_list.reserve(cells);
+        Samples samples;
+        samples.name = "drawList/10k";
+        measure(samples, 50, [&](int) {
+            draw_list.clear();
+            for (int i = 0; i < cells; i++) draw_list.rect(Color(i, i >> 8, 128, 255), cell(i));
+            draw_list.submit();
+            renderer.flush();
+        });
+        results.push_back(std::move(samples));
+    }
+
+    // Texture throughput: 1k 32x32 sprites from one atlas page.
+    {
+        auto atlas = renderer.createTextureAtlas(512);
+        auto surface = SDL_CreateSurface(32, 32, SDL_PIXELFORMAT_ARGB8888);
+        if (!surface) throw_error;
+        auto sprite = atlas.insert(surface);
+        SDL_DestroySurface(surface);
+        Samples samples;
+        samples.name = "renderTexture/1k";
+        measure(samples, 50, [&](int) {
+            for (int i = 0; i < 1000; i++) {
+                RectF destination((i % 40) * 32.0f, (i / 40) * 32.0f, 32.0f, 32.0f);
+                renderer.renderTexture(atlas, sprite, &destination);
+            }
+            renderer.flush();
+        });
+        results.push_back(std::move(samples));
+    }
+
+    // Registry churn: 64 labels created and 64 released per frame, sorted by layer and drawn,
+    // with the released ones destroyed by collect() after the frame. Checks that released
+    // handles go stale and that live handles still name the same label after sort().
+    {
+        struct Label {
+            int layer;
+            int id;
+            SDL::TTF::TextEngine::Text text;
+        };
+        SDL::Registry<Label> labels;
+        std::deque<std::pair<SDL::Registry<Label>::Handle, int>> live;
+        int next = 0;
+        bool resolved = true;
+        Samples samples;
+        samples.name = "registry/churn64";
+        measure(samples, 200, [&](int) {
+            for (int i = 0; i < 64; i++, next++) {
+                live.emplace_back(labels.add(Label{next % 4, next, text_engine.createText(font, "label")}), next);
+            }
+            while (live.size() > 256) {
+                const auto handle = live.front().first;
+                live.pop_front();
+                if (!labels.release(handle) || labels.get(handle)) resolved = false;
+            }
+            labels.sort([](const Label& a, const Label& b) { return a.layer < b.layer; });
+            for (auto& [handle, id] : live) {
+                const Label* label = labels.get(handle);
+                if (!label || label->id != id) resolved = false;
+            }
+            renderer.damageAll();
+            if (renderer.beginFrame(Color{0, 0, 0, 255})) {
+                for (auto& label : labels) label.text.draw(position<float>{label.layer * 40.0f, (label.id % 64) * 10.0f});
+                renderer.endFrame();
+            }
+            labels.collect();
+        });
+        if (!resolved) {
+            std::cerr << "Registry handles did not resolve as expected" << endl;
+            passed = false;
+        }
+        results.push_back(std::move(samples));
+    }
+
+    // Event loop: pushing and draining a burst of 256 events through Events::pump.
+    {
+        std::vector<SDL_Event> batch;
+        batch.reserve(512);
+        SDL_Event event{};
+        event.type = SDL_EVENT_USER;
+        Samples samples;
+        samples.name = "events/pump256";
+        measure(samples, 200, [&](int) {
+            for (int i = 0; i < 256; i++) events.pushEvent(event);
+            events.pump(batch);
+        });
+        results.push_back(std::move(samples));
+    }
+
+    // Steady state: scrolling a laid-out document with highlights and a status line, once
+    // warmed up, must not allocate. Samples are operator new calls per frame.
+    {
+        struct Range {
+            size_t offset;
+            size_t length;
+        };
+        auto document = totpad::Document(filler(size_t(1) << 20));
+        auto view = totpad::TextView(text_engine, font, document);
+        view.resize(viewport);
+        auto glyph_atlas = renderer.createGlyphAtlas();
+        std::vector<Range> ranges;
+        for (size_t offset = 4; offset < size_t(64) << 10; offset += 55) ranges.push_back(Range{offset, 5});
+        const std::string status = "Ln 1, Col 1";
+        auto frame = [&](int i) {
+            view.scroll(static_cast<float>(i % 2 ? -font.lineSkip() : font.lineSkip()));
+            renderer.damage(view.damage(position<float>{0, 0}));
+            if (renderer.beginFrame(Color{0, 0, 0, 255})) {
+                std::vector<RectF, memory::ArenaAllocator<RectF>> boxes{memory::ArenaAllocator<RectF>(renderer.scratch())};
+                view.highlights(position<float>{0, 0}, ranges, boxes);
+                for (auto& box : boxes) renderer.fillRect(Color{72, 64, 16, 255}, box);
+                view.draw(position<float>{0, 0});
+                glyph_atlas.draw(font, status, position<float>{0, 0}, Color{128, 128, 128, 255});
+                glyph_atlas.flush();
+                renderer.endFrame();
+            }
+        };
+        for (int i = 0; i < 50; i++) frame(i);
+        Samples samples;
+        samples.name = "allocations/steadyFrame";
+        samples.unit = "allocs";
+        for (int i = 0; i < 200; i++) {
+            const uint64_t before = allocations.load(std::memory_order_relaxed);
+            frame(i);
+            samples.add(allocations.load(std::memory_order_relaxed) - before);
+        }
+        if (samples.percentile(1.0)) {
+            std::cerr << "Steady-state frames allocated up to " << samples.percentile(1.0) << " times" << endl;
+            passed = false;
+        }
+        results.push_back(std::move(samples));
+    }
+    return passed;
+}
+
+int main (int argc, char* argv[]) {
+    std::vector<Samples> results;
+    bool passed;
+    try {
+        passed = bench(results, argc > 1 ? argv[1] : "Raleway-Black.ttf");
+    } catch (const std::exception& error) {
+        std::cerr << "Error in " << error.what() << endl;
+        std::cerr << "   " << SDL_GetError() << endl;
+        return 1;
+    }
+
+    cout << "{\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        results[i].print(cout);
+        cout << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    cout << "  ]\n}" << endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,420 @@
+// document.hpp
+#pragma once
+
+#include "simd.hpp"
+#include <string>
+#include <string_view>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+namespace totpad {
+
+    // Piece table kept in an implicit treap ordered by document offset.
+    // Every node caches the byte length and newline count of its subtree,
+    // so insert, erase, offset -> line and line -> offset are O(log n).
+    // The original text is immutable and may be a file mapping; copies of it are never made.
+    class Document {
+        struct Piece;
+        public:
+        // Text of a document at one point in time, for writing it out on another thread.
+        // Shares the original text and copies only the add buffer and the piece list.
+        class Snapshot {
+            public:
+            size_t size() const {
+                size_t total = 0;
+                for (auto& piece : pieces) total += piece.length;
+                return total;
+            }
+            // Calls `sink(const char*, size_t)` for every piece in order.
+            template<typename Sink>
+            void read(Sink&& sink) const {
+                for (auto& piece : pieces)
+                    sink((piece.buffer == Original ? text : add.data()) + piece.start, piece.length);
+            }
+            private:
+            friend Document;
+            std::shared_ptr<const void> owner;
+            const char* text = nullptr;
+            std::string add;
+            std::vector<Piece> pieces;
+        };
+
+        Document() = default;
+        explicit Document(std::string text) {
+            auto bytes = std::make_shared<const std::string>(std::move(text));
+            adopt(bytes, bytes->data(), bytes->size());
+            loaded(bytes->size());
+        }
+        // Takes `size` bytes at `text`, kept alive by `owner`, as the original text. None of it
+        // is part of the document until loaded() has indexed it.
+        Document(std::shared_ptr<const void> owner, const char* text, size_t size) {
+            adopt(std::move(owner), text, size);
+        }
+        Document(Document&&) = default;
+        Document& operator=(Document&&) = default;
+        Document(const Document&) = delete;
+        Document& operator=(const Document&) = delete;
+
+        size_t size() const { return length(root); }
+        bool empty() const { return root < 0; }
+        size_t lines() const { return newlines(root) + 1; }
+        // Original text that loaded() has not reached yet. Edits must wait until this is 0.
+        size_t pending() const { return original_size - original_loaded; }
+
+        // Appends the original text up to `end`, indexing it here.
+        void loaded(size_t end) {
+            const size_t count = original.newlines.size();
+            index(original, original_text, original_loaded, end);
+            append(end, original.newlines.size() - count);
+        }
+        // Appends the original text up to `end`, whose newline offsets past the loaded part
+        // were found elsewhere, e.g. on an indexing thread.
+        void loaded(size_t end, const std::vector<size_t>& newlines) {
+            original.newlines.insert(original.newlines.end(), newlines.begin(), newlines.end());
+            append(end, newlines.size());
+        }
+
+        Snapshot snapshot() const {
+            Snapshot out;
+            out.owner = owner;
+            out.text = original_text;
+            out.add = add.data;
+            out.pieces.reserve(nodes.size() - free.size());
+            collect(root, out.pieces);
+            return out;
+        }
+
+        void insert(size_t offset, std::string_view text) {
+            if (text.empty()) return;
+            if (offset > size()) offset = size();
+            const size_t start = add.data.size();
+            add.data.append(text.data(), text.size());
+            index(add, add.data.data(), start, add.data.size());
+
+            int left, right;
+            split(root, offset, left, right);
+            // Consecutive typing extends the previous add piece instead of growing the tree.
+            if (left >= 0) {
+                int last = left;
+                while (nodes[last].right >= 0) last = nodes[last].right;
+                const Piece& piece = nodes[last].piece;
+                if (piece.buffer == Add && piece.start + piece.length == start) {
+                    extend(left, text.size(), count(add, start, start + text.size()));
+                    root = merge(left, right);
+                    return;
+                }
+            }
+            root = merge(merge(left, create(Piece{Add, start, text.size()})), right);
+        }
+
+        void erase(size_t offset, size_t length) {
+            if (offset >= size() || length == 0) return;
+            int left, middle, right;
+            split(root, offset, left, middle);
+            split(middle, length, middle, right);
+            release(middle);
+            root = merge(left, right);
+        }
+
+        // Byte offset where line `line` (0 based) begins.
+        size_t lineStart(size_t line) const {
+            if (line == 0) return 0;
+            if (line >= lines()) return size();
+            return newline(line) + 1;
+        }
+        // Byte offset of the terminating '\n' of `line`, or size() for the last line.
+        size_t lineEnd(size_t line) const {
+            if (line + 1 >= lines()) return size();
+            return newline(line + 1);
+        }
+        size_t lineOf(size_t offset) const {
+            size_t line = 0;
+            int node = root;
+            while (node >= 0) {
+                const Node& n = nodes[node];
+                if (offset < length(n.left)) { node = n.left; continue; }
+                offset -= length(n.left);
+                line += newlines(n.left);
+                if (offset < n.piece.length) {
+                    const Buffer& buffer = of(n.piece);
+                    return line + count(buffer, n.piece.start, n.piece.start + offset);
+                }
+                offset -= n.piece.length;
+                line += n.piece.newlines;
+                node = n.right;
+            }
+            return line;
+        }
+
+        std::string line(size_t index) const {
+            std::string out;
+            line(index, out);
+            return out;
+        }
+        // Into `out`, reusing its capacity.
+        void line(size_t index, std::string& out) const {
+            const size_t start = lineStart(index);
+            out.clear();
+            read(start, lineEnd(index) - start, [&out](const char* data, size_t n) { out.append(data, n); });
+        }
+        std::string text() const { return text(0, size()); }
+        std::string text(size_t offset, size_t length) const {
+            std::string out;
+            out.reserve(length);
+            read(offset, length, [&out](const char* data, size_t n) { out.append(data, n); });
+            return out;
+        }
+        // Calls `sink(const char*, size_t)` for every contiguous span in [offset, offset + length).
+        template<typename Sink>
+        void read(size_t offset, size_t length, Sink&& sink) const {
+            if (offset >= size()) return;
+            length = std::min(length, size() - offset);
+            visit(root, 0, offset, offset + length, sink);
+        }
+        char at(size_t offset) const {
+            int node = root;
+            while (node >= 0) {
+                const Node& n = nodes[node];
+                if (offset < length(n.left)) { node = n.left; continue; }
+                offset -= length(n.left);
+                if (offset < n.piece.length) return bytes(n.piece)[n.piece.start + offset];
+                offset -= n.piece.length;
+                node = n.right;
+            }
+            return '\0';
+        }
+
+        // Start of the UTF-8 codepoint before `offset`. Bytes of malformed sequences count as
+        // codepoints of their own, so stepping never skips over text.
+        size_t previous(size_t offset) const {
+            if (offset == 0) return 0;
+            char bytes[4];
+            const size_t from = offset > 4 ? offset - 4 : 0;
+            copy(from, offset - from, bytes);
+            return from + simd::previous(bytes, offset - from);
+        }
+        // Start of the UTF-8 codepoint after the one at `offset`.
+        size_t next(size_t offset) const {
+            if (offset >= size()) return size();
+            char bytes[4];
+            const size_t available = copy(offset, 4, bytes);
+            return offset + simd::next(bytes, available, 0);
+        }
+
+        private:
+        enum BufferID : uint8_t { Original, Add };
+        // The original buffer leaves `data` empty; its bytes are `original_text`.
+        struct Buffer {
+            std::string data;
+            std::vector<size_t> newlines;
+        };
+        struct Piece {
+            BufferID buffer;
+            size_t start;
+            size_t length;
+            size_t newlines = 0;
+        };
+        struct Node {
+            Piece piece;
+            uint32_t priority;
+            int left = -1;
+            int right = -1;
+            size_t length;
+            size_t newlines;
+        };
+
+        Buffer original;
+        Buffer add;
+        std::shared_ptr<const void> owner;
+        const char* original_text = nullptr;
+        size_t original_size = 0;
+        size_t original_loaded = 0;
+        std::vector<Node> nodes;
+        std::vector<int> free;
+        int root = -1;
+        uint32_t seed = 0x9E3779B9u;
+
+        static void index(Buffer& buffer, const char* data, size_t from, size_t to) {
+            simd::index(data + from, to - from, from, buffer.newlines);
+        }
+        size_t copy(size_t offset, size_t length, char* out) const {
+            size_t copied = 0;
+            read(offset, length, [&](const char* data, size_t n) {
+                std::memcpy(out + copied, data, n);
+                copied += n;
+            });
+            return copied;
+        }
+        static size_t count(const Buffer& buffer, size_t start, size_t end) {
+            auto& lines = buffer.newlines;
+            return std::lower_bound(lines.begin(), lines.end(), end)
+                 - std::lower_bound(lines.begin(), lines.end(), start);
+        }
+        const Buffer& of(const Piece& piece) const {
+            return piece.buffer == Original ? original : add;
+        }
+        const char* bytes(const Piece& piece) const {
+            return piece.buffer == Original ? original_text : add.data.data();
+        }
+        void adopt(std::shared_ptr<const void> bytes, const char* data, size_t size) {
+            owner = std::move(bytes);
+            original_text = data;
+            original_size = size;
+        }
+        // Makes original text [original_loaded, end) with `lines` newlines the end of the document.
+        void append(size_t end, size_t lines) {
+            if (end <= original_loaded) return;
+            const size_t start = original_loaded;
+            original_loaded = end;
+            if (root >= 0) {
+                int last = root;
+                while (nodes[last].right >= 0) last = nodes[last].right;
+                const Piece& piece = nodes[last].piece;
+                if (piece.buffer == Original && piece.start + piece.length == start) {
+                    extend(root, end - start, lines);
+                    return;
+                }
+            }
+            root = merge(root, create(Piece{Original, start, end - start}));
+        }
+        size_t length(int node) const { return node < 0 ? 0 : nodes[node].length; }
+        size_t newlines(int node) const { return node < 0 ? 0 : nodes[node].newlines; }
+
+        // Offset of the k-th (1 based) newline in the document.
+        size_t newline(size_t k) const {
+            size_t base = 0;
+            int node = root;
+            while (node >= 0) {
+                const Node& n = nodes[node];
+                if (k <= newlines(n.left)) { node = n.left; continue; }
+                k -= newlines(n.left);
+                base += length(n.left);
+                if (k <= n.piece.newlines) {
+                    const Buffer& buffer = of(n.piece);
+                    auto first = std::lower_bound(buffer.newlines.begin(), buffer.newlines.end(), n.piece.start);
+                    return base + first[k - 1] - n.piece.start;
+                }
+                k -= n.piece.newlines;
+                base += n.piece.length;
+                node = n.right;
+            }
+            return size();
+        }
+
+        uint32_t random() {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            return seed;
+        }
+        int create(Piece piece) {
+            piece.newlines = count(of(piece), piece.start, piece.start + piece.length);
+            int id;
+            if (!free.empty()) {
+                id = free.back();
+                free.pop_back();
+            } else {
+                id = static_cast<int>(nodes.size());
+                nodes.emplace_back();
+            }
+            Node& n = nodes[id];
+            n.piece = piece;
+            n.priority = random();
+            n.left = n.right = -1;
+            update(id);
+            return id;
+        }
+        void release(int node) {
+            if (node < 0) return;
+            release(nodes[node].left);
+            release(nodes[node].right);
+            free.push_back(node);
+        }
+        void update(int node) {
+            Node& n = nodes[node];
+            n.length = length(n.left) + n.piece.length + length(n.right);
+            n.newlines = newlines(n.left) + n.piece.newlines + newlines(n.right);
+        }
+        void extend(int node, size_t bytes, size_t lines) {
+            Node& n = nodes[node];
+            n.length += bytes;
+            n.newlines += lines;
+            if (n.right >= 0) extend(n.right, bytes, lines);
+            else {
+                n.piece.length += bytes;
+                n.piece.newlines += lines;
+            }
+        }
+
+        // Splits `node` into the first `offset` bytes and the rest, cutting a piece if needed.
+        void split(int node, size_t offset, int& left, int& right) {
+            if (node < 0) { left = right = -1; return; }
+            const size_t before = length(nodes[node].left);
+            if (offset <= before) {
+                int inner;
+                split(nodes[node].left, offset, left, inner);
+                nodes[node].left = inner;
+                update(node);
+                right = node;
+            } else if (offset >= before + nodes[node].piece.length) {
+                int inner;
+                split(nodes[node].right, offset - before - nodes[node].piece.length, inner, right);
+                nodes[node].right = inner;
+                update(node);
+                left = node;
+            } else {
+                const size_t cut = offset - before;
+                Piece tail = nodes[node].piece;
+                tail.start += cut;
+                tail.length -= cut;
+                const int second = create(tail);
+                const int after = nodes[node].right;
+                Node& n = nodes[node];
+                n.piece.length = cut;
+                n.piece.newlines -= nodes[second].piece.newlines;
+                n.right = -1;
+                update(node);
+                left = node;
+                right = merge(second, after);
+            }
+        }
+        int merge(int left, int right) {
+            if (left < 0) return right;
+            if (right < 0) return left;
+            if (nodes[left].priority > nodes[right].priority) {
+                const int merged = merge(nodes[left].right, right);
+                nodes[left].right = merged;
+                update(left);
+                return left;
+            }
+            const int merged = merge(left, nodes[right].left);
+            nodes[right].left = merged;
+            update(right);
+            return right;
+        }
+
+        template<typename Sink>
+        void visit(int node, size_t base, size_t from, size_t to, Sink& sink) const {
+            if (node < 0 || from >= to) return;
+            const Node& n = nodes[node];
+            if (base >= to || base + n.length <= from) return;
+            visit(n.left, base, from, to, sink);
+            const size_t start = base + length(n.left);
+            const size_t end = start + n.piece.length;
+            const size_t a = std::max(start, from), b = std::min(end, to);
+            if (a < b) sink(bytes(n.piece) + n.piece.start + (a - start), b - a);
+            visit(n.right, end, from, to, sink);
+        }
+        void collect(int node, std::vector<Piece>& out) const {
+            if (node < 0) return;
+            collect(nodes[node].left, out);
+            out.push_back(nodes[node].piece);
+            collect(nodes[node].right, out);
+        }
+    };
+
+} // namespace totpad
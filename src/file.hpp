@@ -0,0 +1,343 @@
+// file.hpp
+#pragma once
+
+#include "sdl.hpp"
+#include "document.hpp"
+#include "assets.hpp"
+#include "simd.hpp"
+#include "jobs.hpp"
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+
+#if defined(_WIN32)
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#elif defined(__unix__) || defined(__APPLE__)
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+namespace totpad {
+
+    // Opens files into a Document. Small files are streamed into the original buffer in one go.
+    // Large ones are mapped instead: the first screenful is indexed right away and a thread
+    // indexes the rest chunk by chunk, which update() appends to the document. With a
+    // scheduler, a batch of chunks (one per thread) is indexed in parallel at a time. The
+    // document has to stay read-only until pending() reaches 0.
+    class Loader {
+        public:
+        static constexpr size_t map_threshold = size_t(4) << 20;
+        static constexpr size_t read_chunk = size_t(64) << 10;
+        static constexpr size_t first_chunk = size_t(256) << 10;
+        static constexpr size_t index_chunk = size_t(8) << 20;
+
+        // With a nonzero `wake`, the indexing thread pushes an event of that type per chunk.
+        explicit Loader(const uint32_t wake = 0, jobs::Scheduler* scheduler = nullptr): wake(wake), scheduler(scheduler) {}
+        Loader(const Loader&) = delete;
+        Loader& operator=(const Loader&) = delete;
+        ~Loader() {
+            cancel();
+        }
+
+        // Replaces `document` with the contents of `path`; throws if it can't be read.
+        void open(Document& document, const std::string& path) {
+            cancel();
+            auto stream = SDL_IOFromFile(path.c_str(), "rb");
+            if (!stream) throw_error;
+            const int64_t size = SDL_GetIOSize(stream);
+            if (size >= 0 && static_cast<uint64_t>(size) >= map_threshold) {
+                SDL_CloseIO(stream);
+                auto mapping = std::make_shared<const assets::Mapping>(path);
+                document = Document(mapping, mapping->data(), mapping->size());
+                const size_t end = boundary(mapping->data(), 0, std::min(mapping->size(), first_chunk), mapping->size());
+                document.loaded(end);
+                malformed = !simd::validate(mapping->data(), end);
+                if (end < mapping->size()) worker = std::thread([this, mapping, end] { work(mapping, end); });
+                return;
+            }
+            std::string text;
+            if (size > 0) text.reserve(static_cast<size_t>(size));
+            malformed = false;
+            size_t used = 0;
+            for (;;) {
+                text.resize(used + read_chunk);
+                const size_t read = SDL_ReadIO(stream, &text[used], read_chunk);
+                used += read;
+                if (!read) break;
+            }
+            text.resize(used);
+            const bool failed = SDL_GetIOStatus(stream) == SDL_IO_STATUS_ERROR;
+            SDL_CloseIO(stream);
+            if (failed) throw_error;
+            malformed = !simd::validate(text.data(), text.size());
+            document = Document(std::move(text));
+        }
+        // Appends the chunks indexed so far to `document`; returns whether there were any.
+        bool update(Document& document) {
+            // Read before taking the chunks, so the last chunk can't be pushed in between.
+            const bool done = finished;
+            std::deque<Chunk> ready;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ready.swap(chunks);
+            }
+            for (auto& chunk : ready) document.loaded(chunk.end, chunk.newlines);
+            if (worker.joinable() && done) worker.join();
+            return !ready.empty();
+        }
+        bool busy() const {
+            return worker.joinable();
+        }
+        // Whether the part of the file read so far is not well-formed UTF-8.
+        bool invalid() const {
+            return malformed;
+        }
+        void cancel() {
+            cancelled = true;
+            if (worker.joinable()) worker.join();
+            cancelled = false;
+            finished = false;
+            chunks.clear();
+        }
+        private:
+        struct Chunk {
+            size_t end;
+            std::vector<size_t> newlines;
+        };
+        uint32_t wake;
+        jobs::Scheduler* scheduler;
+        std::thread worker;
+        std::atomic<bool> cancelled{false};
+        std::atomic<bool> finished{false};
+        std::atomic<bool> malformed{false};
+        std::mutex mutex;
+        std::deque<Chunk> chunks;
+
+        // End of a chunk in [from, to): just past its last newline, so lines are not split,
+        // or failing that the last codepoint boundary.
+        static size_t boundary(const char* data, size_t from, size_t to, size_t size) {
+            if (to >= size) return size;
+            for (size_t i = to; i > from; i--)
+                if (data[i - 1] == '\n') return i;
+            size_t cut = to;
+            while (cut > from && to - cut < 3 && (static_cast<unsigned char>(data[cut]) & 0xC0) == 0x80) cut--;
+            return cut > from ? cut : to;
+        }
+        void work(std::shared_ptr<const assets::Mapping> mapping, size_t from) {
+            const char* data = mapping->data();
+            const size_t size = mapping->size();
+            const size_t batch = scheduler ? scheduler->size() : 1;
+            std::vector<size_t> starts;
+            std::vector<Chunk> indexed;
+            auto index = [&](size_t first, size_t last) {
+                for (size_t i = first; i < last; i++) {
+                    const size_t start = starts[i], end = indexed[i].end;
+                    simd::index(data + start, end - start, start, indexed[i].newlines);
+                    if (!malformed && !simd::validate(data + start, end - start)) malformed = true;
+                }
+            };
+            while (from < size && !cancelled) {
+                starts.clear();
+                indexed.clear();
+                for (size_t i = 0; i < batch && from < size; i++) {
+                    starts.push_back(from);
+                    from = boundary(data, from, std::min(size, from + index_chunk), size);
+                    indexed.push_back(Chunk{from, {}});
+                }
+                if (scheduler) scheduler->parallel_for(0, indexed.size(), 1, index);
+                else index(0, indexed.size());
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    for (auto& chunk : indexed) chunks.push_back(std::move(chunk));
+                }
+                finished = from >= size;
+                notify();
+            }
+        }
+        void notify() {
+            if (!wake) return;
+            SDL_Event event{};
+            event.type = wake;
+            SDL_PushEvent(&event);
+        }
+    };
+
+    // Writes document snapshots on a background thread, so saving never blocks a frame. The
+    // text goes to a temporary file next to the target which is then renamed over it; a failed
+    // or interrupted save leaves the previous file intact. The temporary file takes the target's
+    // permissions and is synced to disk before the rename, and a symlink is saved through to
+    // the file it points at rather than replaced. Saves requested while one is running
+    // are queued, keeping only the newest; one still queued on destruction is written before
+    // the destructor returns.
+    class Saver {
+        public:
+        enum class State { Idle, Saving, Saved, Failed };
+
+        explicit Saver(const uint32_t wake = 0): wake(wake) {}
+        Saver(const Saver&) = delete;
+        Saver& operator=(const Saver&) = delete;
+        ~Saver() {
+            if (worker.joinable()) worker.join();
+            if (next) {
+                wake = 0;
+                current = std::move(next);
+                work();
+            }
+        }
+
+        void save(const Document& document, const std::string& path) {
+            next.reset(new Job{document.snapshot(), path, std::string()});
+            poll();
+        }
+        // Starts a queued save and reports a finished one exactly once.
+        State poll() {
+            State state = State::Idle;
+            if (worker.joinable() && finished) {
+                worker.join();
+                finished = false;
+                state = current->error.empty() ? State::Saved : State::Failed;
+                _error = std::move(current->error);
+                current.reset();
+            }
+            if (!worker.joinable() && next) {
+                current = std::move(next);
+                worker = std::thread([this] { work(); });
+            }
+            if (state == State::Idle && busy()) state = State::Saving;
+            return state;
+        }
+        bool busy() const {
+            return worker.joinable() || next;
+        }
+        // Why the last failed save failed.
+        const std::string& error() const {
+            return _error;
+        }
+        private:
+        struct Job {
+            Document::Snapshot snapshot;
+            std::string path;
+            std::string error;
+        };
+        uint32_t wake;
+        std::thread worker;
+        std::atomic<bool> finished{false};
+        std::unique_ptr<Job> current;
+        std::unique_ptr<Job> next;
+        std::string _error;
+
+        void work() {
+            Job& job = *current;
+            const std::string path = target(job.path);
+            const std::string temporary = path + ".totpad~";
+            auto file = SDL_IOFromFile(temporary.c_str(), "wb");
+            // Before any text goes in, so a private file's contents are never readable by others.
+            bool written = file && permissions(path, temporary);
+            if (file) {
+                job.snapshot.read([&](const char* data, size_t size) {
+                    if (written) written = SDL_WriteIO(file, data, size) == size;
+                });
+                written = written && SDL_FlushIO(file);
+                written = SDL_CloseIO(file) && written;
+                written = written && sync(temporary);
+            }
+            // Replacing a file that is still mapped fails on Windows; it then stays untouched.
+            if (written) written = SDL_RenamePath(temporary.c_str(), path.c_str());
+            if (!written) {
+                job.error = SDL_GetError();
+                if (job.error.empty()) job.error = "Could not write " + job.path;
+                if (file) SDL_RemovePath(temporary.c_str());
+            }
+            finished = true;
+            if (wake) {
+                SDL_Event event{};
+                event.type = wake;
+                SDL_PushEvent(&event);
+            }
+        }
+#if defined(_WIN32)
+        static std::wstring widen(const std::string& path) {
+            const int length = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0);
+            std::wstring wide(length > 0 ? length : 1, L'\0');
+            MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, wide.data(), length);
+            return wide;
+        }
+#endif
+        // The file a save to `path` replaces: symlinks are followed so that the link survives and
+        // its target gets the text. `path` itself when it doesn't exist yet.
+        static std::string target(const std::string& path) {
+#if defined(_WIN32)
+            HANDLE file = CreateFileW(widen(path).c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+            if (file == INVALID_HANDLE_VALUE) return path;
+            wchar_t resolved[MAX_PATH * 4];
+            const DWORD length = GetFinalPathNameByHandleW(file, resolved, MAX_PATH * 4, FILE_NAME_NORMALIZED | VOLUME_NAME_DOS);
+            CloseHandle(file);
+            if (!length || length >= MAX_PATH * 4) return path;
+            // Drop the \\?\ prefix, turning \\?\UNC\server back into \\server.
+            std::wstring wide(resolved, length);
+            if (wide.compare(0, 8, L"\\\\?\\UNC\\") == 0) wide = L"\\" + wide.substr(7);
+            else if (wide.compare(0, 4, L"\\\\?\\") == 0) wide = wide.substr(4);
+            const int bytes = WideCharToMultiByte(CP_UTF8, 0, wide.c_str(), -1, nullptr, 0, nullptr, nullptr);
+            if (bytes <= 1) return path;
+            std::string out(bytes - 1, '\0');
+            WideCharToMultiByte(CP_UTF8, 0, wide.c_str(), -1, out.data(), bytes, nullptr, nullptr);
+            return out;
+#elif defined(__unix__) || defined(__APPLE__)
+            char* resolved = realpath(path.c_str(), nullptr);
+            if (!resolved) return path;
+            std::string out(resolved);
+            std::free(resolved);
+            return out;
+#else
+            return path;
+#endif
+        }
+        // Gives `temporary` the permission bits of `path`, if that exists. Windows files take
+        // their ACLs from the directory, so there is nothing to copy there.
+        static bool permissions(const std::string& path, const std::string& temporary) {
+#if defined(__unix__) || defined(__APPLE__)
+            struct stat info;
+            if (stat(path.c_str(), &info) != 0) return true;
+            if (chmod(temporary.c_str(), info.st_mode & 07777) != 0) {
+                SDL_SetError("Could not set the permissions of %s", temporary.c_str());
+                return false;
+            }
+#else
+            (void)path;
+            (void)temporary;
+#endif
+            return true;
+        }
+        // Forces the written text onto the disk; SDL_FlushIO only empties the stdio buffers. Without
+        // it a crash just after the rename can leave an empty file on some filesystems.
+        static bool sync(const std::string& file) {
+#if defined(_WIN32)
+            HANDLE handle = CreateFileW(widen(file).c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            bool synced = handle != INVALID_HANDLE_VALUE && FlushFileBuffers(handle);
+            if (handle != INVALID_HANDLE_VALUE) CloseHandle(handle);
+#elif defined(__unix__) || defined(__APPLE__)
+            const int handle = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+            bool synced = handle >= 0 && fsync(handle) == 0;
+            if (handle >= 0) ::close(handle);
+#else
+            bool synced = true;
+#endif
+            if (!synced) SDL_SetError("Could not sync %s", file.c_str());
+            return synced;
+        }
+    };
+
+} // namespace totpad
@@ -0,0 +1,255 @@
+// history.hpp
+#pragma once
+
+#include "document.hpp"
+#include "simd.hpp"
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <string_view>
+
+namespace totpad {
+
+    // Undo/redo for a Document. Edits go through insert() and erase(), which apply them and
+    // record only the bytes that changed, so undoing or redoing costs O(edit size) whatever the
+    // document's size. Record text is bump-allocated from 64 KiB arena blocks. Consecutive
+    // keystrokes coalesce into one record per word. When the history outgrows its budget, the
+    // oldest records and their blocks are dropped.
+    class History {
+        public:
+        // A document change as TextView::edited() takes it.
+        struct Change {
+            size_t line;
+            size_t old_lines;
+            size_t new_lines;
+            size_t caret;
+        };
+        static constexpr size_t block_size = size_t(64) << 10;
+        // Coalesced deletes are rebuilt on every keystroke, so a run stops growing here.
+        static constexpr size_t coalesce_limit = 256;
+
+        explicit History(const size_t budget = size_t(8) << 20): budget(budget) {}
+
+        // Inserts `text` at `offset`. `typed` edits may merge into the previous record.
+        Change insert(Document& document, const size_t offset, const std::string_view text, const bool typed = false) {
+            const size_t line = document.lineOf(offset);
+            document.insert(offset, text);
+            const size_t lines = simd::count(text.data(), text.size());
+            const Change change{line, 1, 1 + lines, offset + text.size()};
+            if (text.empty()) return change;
+            discard();
+            Record* last = done ? &records.back() : nullptr;
+            if (typed && last && last->kind == Typing && !last->removed_size
+                && offset == last->offset + last->inserted_size
+                && !(space(last->inserted[last->inserted_size - 1]) && !space(text[0]))) {
+                if (!extend(last->inserted, last->inserted_size, text.size())) {
+                    char* moved = allocate(last->inserted_size + text.size());
+                    std::memcpy(moved, last->inserted, last->inserted_size);
+                    last->inserted = moved;
+                }
+                std::memcpy(last->inserted + last->inserted_size, text.data(), text.size());
+                last->inserted_size += text.size();
+                last->inserted_lines += lines;
+            }
+            else {
+                Record record = begin(typed ? Typing : Other, offset, offset, here());
+                record.inserted = store(text.data(), text.size());
+                record.inserted_size = text.size();
+                record.inserted_lines = lines;
+                push(record);
+            }
+            trim();
+            return change;
+        }
+        // Erases `length` bytes at `offset`. A `typed` erase just before the previous one (a
+        // run of backspaces) merges into it.
+        Change erase(Document& document, const size_t offset, size_t length, const bool typed = false) {
+            length = std::min(length, document.size() - std::min(offset, document.size()));
+            const size_t line = document.lineOf(offset);
+            if (!length) return Change{line, 1, 1, offset};
+            discard();
+            Record* last = done ? &records.back() : nullptr;
+            const Mark mark = here();
+            char* removed = allocate(length);
+            size_t copied = 0;
+            document.read(offset, length, [&](const char* data, size_t n) {
+                std::memcpy(removed + copied, data, n);
+                copied += n;
+            });
+            const size_t lines = simd::count(removed, length);
+            if (typed && last && last->kind == Deleting && !last->inserted_size
+                && offset + length == last->offset && last->removed_size + length <= coalesce_limit
+                && !(space(removed[length - 1]) && !space(last->removed[0]))) {
+                char* joined = allocate(length + last->removed_size);
+                std::memcpy(joined, removed, length);
+                std::memcpy(joined + length, last->removed, last->removed_size);
+                last->offset = offset;
+                last->removed = joined;
+                last->removed_size += length;
+                last->removed_lines += lines;
+            }
+            else {
+                Record record = begin(typed ? Deleting : Other, offset, offset + length, mark);
+                record.removed = removed;
+                record.removed_size = length;
+                record.removed_lines = lines;
+                push(record);
+            }
+            document.erase(offset, length);
+            trim();
+            return Change{line, 1 + lines, 1, offset};
+        }
+
+        bool canUndo() const {
+            return done > 0;
+        }
+        bool canRedo() const {
+            return done < records.size();
+        }
+        // Reverts the newest applied record; the caret goes back to where it was before it.
+        Change undo(Document& document) {
+            const Record& record = records[--done];
+            Change change = replace(document, record.offset, record.inserted_size, record.inserted_lines,
+                record.removed, record.removed_size, record.removed_lines);
+            change.caret = record.caret;
+            return change;
+        }
+        Change redo(Document& document) {
+            const Record& record = records[done++];
+            return replace(document, record.offset, record.removed_size, record.removed_lines,
+                record.inserted, record.inserted_size, record.inserted_lines);
+        }
+        void clear() {
+            records.clear();
+            blocks.clear();
+            first = 0;
+            done = 0;
+            used = 0;
+        }
+        // Ends the current coalescing run, e.g. when the caret moved away.
+        void seal() {
+            if (done) records[done - 1].kind = Other;
+        }
+        void setBudget(const size_t bytes) {
+            budget = bytes;
+            trim();
+        }
+        size_t getBudget() const {
+            return budget;
+        }
+        // Bytes held by records and arena blocks.
+        size_t bytes() const {
+            return used + records.size() * sizeof(Record);
+        }
+
+        private:
+        enum Kind : uint8_t { Other, Typing, Deleting };
+        // Position in the arena: block sequence number and bytes used in it.
+        struct Mark {
+            size_t block;
+            size_t used;
+        };
+        struct Record {
+            size_t offset;
+            size_t caret;
+            char* inserted;
+            char* removed;
+            size_t inserted_size;
+            size_t removed_size;
+            size_t inserted_lines;
+            size_t removed_lines;
+            Mark mark;
+            Kind kind;
+        };
+        struct Block {
+            std::unique_ptr<char[]> data;
+            size_t capacity;
+            size_t used;
+        };
+        size_t budget;
+        std::deque<Record> records;
+        std::deque<Block> blocks;
+        // Sequence number of blocks.front().
+        size_t first = 0;
+        // Records [0, done) are applied; the rest can be redone.
+        size_t done = 0;
+        // Total capacity of the blocks.
+        size_t used = 0;
+
+        static bool space(const char c) {
+            return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+        }
+        Change replace(Document& document, size_t offset, size_t length, size_t lines, const char* text, size_t size, size_t new_lines) {
+            const size_t line = document.lineOf(offset);
+            document.erase(offset, length);
+            document.insert(offset, std::string_view(text ? text : "", size));
+            return Change{line, 1 + lines, 1 + new_lines, offset + size};
+        }
+        // Where the next allocation goes; past a full block, so that trimming can free it.
+        Mark here() const {
+            if (blocks.empty() || blocks.back().used == blocks.back().capacity) return Mark{first + blocks.size(), 0};
+            return Mark{first + blocks.size() - 1, blocks.back().used};
+        }
+        Record begin(const Kind kind, const size_t offset, const size_t caret, const Mark mark) {
+            Record record{};
+            record.offset = offset;
+            record.caret = caret;
+            record.kind = kind;
+            record.mark = mark;
+            return record;
+        }
+        void push(const Record& record) {
+            records.push_back(record);
+            done = records.size();
+        }
+        char* allocate(const size_t size) {
+            if (blocks.empty() || blocks.back().capacity - blocks.back().used < size) {
+                const size_t capacity = std::max(block_size, size);
+                blocks.push_back(Block{std::unique_ptr<char[]>(new char[capacity]), capacity, 0});
+                used += capacity;
+            }
+            auto& block = blocks.back();
+            char* out = block.data.get() + block.used;
+            block.used += size;
+            return out;
+        }
+        char* store(const char* data, const size_t size) {
+            char* out = allocate(size);
+            std::memcpy(out, data, size);
+            return out;
+        }
+        // Grows the newest allocation in place when it ends the last block and there is room.
+        bool extend(const char* data, const size_t size, const size_t extra) {
+            if (blocks.empty()) return false;
+            auto& block = blocks.back();
+            if (data + size != block.data.get() + block.used || block.capacity - block.used < extra) return false;
+            block.used += extra;
+            return true;
+        }
+        // A new edit after undoing forks the history: the redo records and their text go.
+        void discard() {
+            if (done == records.size()) return;
+            const Mark mark = records[done].mark;
+            records.erase(records.begin() + static_cast<std::ptrdiff_t>(done), records.end());
+            while (!blocks.empty() && first + blocks.size() - 1 > mark.block) {
+                used -= blocks.back().capacity;
+                blocks.pop_back();
+            }
+            if (!blocks.empty() && first + blocks.size() - 1 == mark.block) blocks.back().used = mark.used;
+        }
+        // Drops the oldest applied records, and the blocks only they used, until within budget.
+        // The newest record is always kept, however large.
+        void trim() {
+            while (bytes() > budget && done > 1) {
+                records.pop_front();
+                done--;
+                while (first < records.front().mark.block) {
+                    used -= blocks.front().capacity;
+                    blocks.pop_front();
+                    first++;
+                }
+            }
+        }
+    };
+
+} // namespace totpad
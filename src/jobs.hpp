@@ -0,0 +1,279 @@
+// jobs.hpp
+#pragma once
+
+#include <SDL3/SDL.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing task scheduler. Each worker has its own deque: it pushes and pops its own
+// tasks at the back, most recent first, while idle workers steal the oldest from the front
+// of the others'. Tasks submitted from other threads go to a shared queue. Threads that wait
+// for a task or group run queued tasks meanwhile, so waiting inside a task doesn't deadlock.
+//     jobs::Scheduler scheduler;
+//     auto a = scheduler.submit([] { ... });
+//     auto b = scheduler.submit([] { ... }, {a});  // runs after a
+//     scheduler.parallel_for(0, n, 1024, [&](size_t from, size_t to) { ... });
+//     scheduler.wait(b);
+namespace jobs {
+
+    class Scheduler;
+
+    class Task {
+        public:
+        bool done() const {
+            return finished.load(std::memory_order_acquire);
+        }
+        private:
+        friend Scheduler;
+        std::function<void()> work;
+        std::atomic<int> blockers{1};
+        std::atomic<bool> finished{false};
+        std::exception_ptr error;
+        std::mutex lock;
+        std::vector<std::shared_ptr<Task>> successors;
+    };
+    using Handle = std::shared_ptr<Task>;
+
+    // Tasks to wait for together; the first exception one of them throws is rethrown by wait().
+    class Group {
+        public:
+        bool done() const {
+            return pending.load(std::memory_order_acquire) == 0;
+        }
+        private:
+        friend Scheduler;
+        std::atomic<size_t> pending{0};
+        std::mutex lock;
+        std::exception_ptr error;
+    };
+
+    class Scheduler {
+        public:
+        // By default one worker per logical core besides the thread that creates it.
+        explicit Scheduler(unsigned int threads = 0) {
+            if (!threads) {
+                const int cores = SDL_GetNumLogicalCPUCores();
+                threads = cores > 1 ? static_cast<unsigned int>(cores - 1) : 1;
+            }
+            for (unsigned int i = 0; i <= threads; i++) queues.emplace_back(new Queue);
+            try {
+                for (unsigned int i = 0; i < threads; i++) workers.emplace_back([this, i] { work(i); });
+            } catch (...) {
+                // The destructor won't run, so stop the workers that did start before unwinding.
+                {
+                    std::lock_guard<std::mutex> lock(sleep_lock);
+                    stopping = true;
+                }
+                sleep.notify_all();
+                for (auto& worker : workers) worker.join();
+                throw;
+            }
+        }
+        Scheduler(const Scheduler&) = delete;
+        Scheduler& operator=(const Scheduler&) = delete;
+        // Runs everything queued, then stops. Tasks still waiting on dependencies are dropped.
+        ~Scheduler() {
+            {
+                std::lock_guard<std::mutex> lock(sleep_lock);
+                stopping = true;
+            }
+            sleep.notify_all();
+            for (auto& worker : workers) worker.join();
+        }
+        // Threads running tasks when someone is waiting: the workers plus the waiter.
+        unsigned int size() const {
+            return static_cast<unsigned int>(workers.size()) + 1;
+        }
+
+        // Queues `work` to run once every task in `after` has finished.
+        Handle submit(std::function<void()> work, std::initializer_list<Handle> after = {}) {
+            return submit(std::move(work), after.begin(), after.end());
+        }
+        Handle submit(std::function<void()> work, const std::vector<Handle>& after) {
+            return submit(std::move(work), after.data(), after.data() + after.size());
+        }
+        void submit(Group& group, std::function<void()> work) {
+            group.pending.fetch_add(1, std::memory_order_relaxed);
+            submit([&group, work = std::move(work)] {
+                try {
+                    work();
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(group.lock);
+                    if (!group.error) group.error = std::current_exception();
+                }
+                group.pending.fetch_sub(1, std::memory_order_acq_rel);
+            });
+        }
+        // Runs queued tasks until `task` has finished; rethrows what it threw.
+        void wait(const Handle& task) {
+            help([&task] { return task->done(); });
+            if (task->error) std::rethrow_exception(task->error);
+        }
+        void wait(Group& group) {
+            help([&group] { return group.done(); });
+            std::exception_ptr error;
+            {
+                std::lock_guard<std::mutex> lock(group.lock);
+                std::swap(error, group.error);
+            }
+            if (error) std::rethrow_exception(error);
+        }
+        // Calls `fn(from, to)` over [begin, end) in slices of at least `grain`, on the workers and
+        // the calling thread, and returns when all slices have run.
+        template<typename Fn>
+        void parallel_for(const size_t begin, const size_t end, size_t grain, Fn&& fn) {
+            if (begin >= end) return;
+            if (!grain) grain = 1;
+            const size_t slices = std::min((end - begin + grain - 1) / grain, static_cast<size_t>(size()) * 4);
+            if (slices <= 1) {
+                fn(begin, end);
+                return;
+            }
+            const size_t step = (end - begin + slices - 1) / slices;
+            Group group;
+            for (size_t from = begin + step; from < end; from += step) {
+                const size_t to = std::min(end, from + step);
+                submit(group, [&fn, from, to] { fn(from, to); });
+            }
+            // The caller takes the first slice itself instead of queueing it.
+            try {
+                fn(begin, std::min(end, begin + step));
+            } catch (...) {
+                help([&group] { return group.done(); });
+                throw;
+            }
+            wait(group);
+        }
+
+        private:
+        struct Queue {
+            std::mutex lock;
+            std::deque<Handle> tasks;
+        };
+        // Index of the current thread's queue if it is one of our workers.
+        inline static thread_local const Scheduler* owner = nullptr;
+        inline static thread_local size_t slot = 0;
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::vector<std::thread> workers;
+        std::atomic<size_t> queued{0};
+        std::atomic<int> waiting{0};
+        std::mutex sleep_lock;
+        std::condition_variable sleep;
+        bool stopping = false;
+
+        template<typename Iterator>
+        Handle submit(std::function<void()> work, Iterator first, Iterator last) {
+            auto task = std::make_shared<Task>();
+            task->work = std::move(work);
+            for (; first != last; ++first) {
+                const Handle& before = *first;
+                if (!before) continue;
+                std::lock_guard<std::mutex> lock(before->lock);
+                if (before->finished.load(std::memory_order_relaxed)) continue;
+                task->blockers.fetch_add(1, std::memory_order_relaxed);
+                before->successors.push_back(task);
+            }
+            if (task->blockers.fetch_sub(1, std::memory_order_acq_rel) == 1) push(task);
+            return task;
+        }
+        // Workers push to their own deque, everyone else to the shared one (the last).
+        void push(Handle task) {
+            Queue& queue = owner == this ? *queues[slot] : *queues.back();
+            // Counted first, so `queued` never drops below the tasks actually queued.
+            queued.fetch_add(1, std::memory_order_release);
+            {
+                std::lock_guard<std::mutex> lock(queue.lock);
+                queue.tasks.push_back(std::move(task));
+            }
+            {
+                std::lock_guard<std::mutex> lock(sleep_lock);
+            }
+            sleep.notify_one();
+        }
+        Handle pop() {
+            if (!queued.load(std::memory_order_acquire)) return nullptr;
+            const size_t self = owner == this ? slot : queues.size() - 1;
+            Handle task;
+            if (owner == this) {
+                Queue& own = *queues[self];
+                std::lock_guard<std::mutex> lock(own.lock);
+                if (!own.tasks.empty()) {
+                    task = std::move(own.tasks.back());
+                    own.tasks.pop_back();
+                }
+            }
+            for (size_t i = 1; !task && i <= queues.size(); i++) {
+                Queue& victim = *queues[(self + i) % queues.size()];
+                std::lock_guard<std::mutex> lock(victim.lock);
+                if (!victim.tasks.empty()) {
+                    task = std::move(victim.tasks.front());
+                    victim.tasks.pop_front();
+                }
+            }
+            if (task) queued.fetch_sub(1, std::memory_order_acq_rel);
+            return task;
+        }
+        void run(const Handle& task) {
+            try {
+                task->work();
+            } catch (...) {
+                task->error = std::current_exception();
+            }
+            task->work = nullptr;
+            std::vector<Handle> successors;
+            {
+                std::lock_guard<std::mutex> lock(task->lock);
+                task->finished.store(true, std::memory_order_release);
+                successors.swap(task->successors);
+            }
+            for (auto& next : successors)
+                if (next->blockers.fetch_sub(1, std::memory_order_acq_rel) == 1) push(std::move(next));
+            if (waiting.load(std::memory_order_acquire)) {
+                {
+                    std::lock_guard<std::mutex> lock(sleep_lock);
+                }
+                sleep.notify_all();
+            }
+        }
+        bool runOne() {
+            auto task = pop();
+            if (!task) return false;
+            run(task);
+            return true;
+        }
+        template<typename Done>
+        void help(Done&& done) {
+            while (!done()) {
+                if (runOne()) continue;
+                waiting.fetch_add(1, std::memory_order_acq_rel);
+                {
+                    // Timed, since a task can finish between the check and the wait.
+                    std::unique_lock<std::mutex> lock(sleep_lock);
+                    sleep.wait_for(lock, std::chrono::milliseconds(1), [&] { return done() || queued.load() > 0; });
+                }
+                waiting.fetch_sub(1, std::memory_order_acq_rel);
+            }
+        }
+        void work(const size_t index) {
+            owner = this;
+            slot = index;
+            for (;;) {
+                if (runOne()) continue;
+                std::unique_lock<std::mutex> lock(sleep_lock);
+                sleep.wait(lock, [this] { return stopping || queued.load() > 0; });
+                if (stopping && !queued.load()) return;
+            }
+        }
+    };
+
+} // namespace jobs
@@ -1,6 +1,11 @@
 #include "sdl.hpp"
+#include "view.hpp"
+#include "profile.hpp"
+#include "assets.hpp"
+#include "model.hpp"
 #include <iostream>
 #include <vector>
+#include <algorithm>
 
 using RectF = math::Rectangle<float>;
 using math::Color;
@@ -11,34 +16,7 @@ using std::cout, std::endl;
 
 #define CASE(x, task) case x: {task break;}
 
-struct Font {
-    std::vector<std::unique_ptr<SDL::TTF::Font>> sizes;
-    Font(SDL::TTF& ttf, const char* file, const float max_point_size, const float scale, const unsigned char _sizes) {
-        int dpi = 96 * scale;
-        min_point_size = max_point_size / _sizes;
-        unsigned char i = 0;
-        while (i < _sizes) {
-            auto config = std::make_unique<SDL::TTF::Font::Config>();
-            config->set("filename", file);
-            config->set("size", min_point_size * ++i);
-            config->set("hdpi", dpi); config->set("vdpi", dpi);
-            sizes.push_back(ttf.loadFontU(*config));
-        }
-    }
-    void scale(const float value) {
-        unsigned char i = 0;
-        while (i < sizes.size()) {
-            sizes[i]->sizeAndScale(min_point_size * ++i, value);
-        }
-    }
-    SDL::TTF::Font& get(const unsigned char index) {
-        return *sizes[index];
-    }
-    private:
-    float min_point_size;
-};
-
-inline void code() {
+inline void code(const char* file) {
     SDL sdl;
     auto events = sdl.initEvents();
     auto ttf = sdl.initTTF();
@@ -49,10 +27,10 @@ inline void code() {
         bool running = true;
         float scale;
         // position<float> cursor;
-        float target_frequency;
-        float time;
         // std::unordered_map<unsigned int, bool> keys;
         size<int> viewport;
+        std::string status;
+        std::string title;
     } gui;
     gui.viewport = size<int> {display.w >> 1, display.h >> 1};
 
@@ -60,89 +38,256 @@ inline void code() {
     window.setMinimumSize(size<int> {gui.viewport.width >> 1, gui.viewport.height >> 1});
 
     gui.scale = window.scale();
-    gui.target_frequency = (1000.0f * display.refresh_rate_denominator) / display.refresh_rate_numerator;
-    gui.time = 0;
 
     auto renderer = window.createRenderer("opengl");
-    auto font = Font(ttf, "Raleway-Black.ttf", 24.0f, gui.scale, 1);
+    auto pacer = SDL::FramePacer(
+        renderer.setVSync(1) ? SDL::FramePacer::Mode::VSync : SDL::FramePacer::Mode::Fixed,
+        SDL::FramePacer::refreshPeriod(display)
+    );
+    // Assets live next to the executable, in totpad.pak when it was packed, else as loose files.
+    const char* base = SDL_GetBasePath();
+    assets::Source source(base ? base : "");
+    try {
+        source.mount("totpad.pak");
+    } catch (const std::exception&) {
+        debug_log("No asset bundle: %s", SDL_GetError());
+    }
+    auto fonts = ttf.createFontCache();
+    fonts.setLoader(source.fontLoader());
+    auto dpi = [&] { return static_cast<int>(96 * gui.scale); };
+    auto font = fonts.get("Raleway-Black.ttf", 24.0f, dpi());
     auto text_engine = renderer.createTextEngine();
-    std::string str = "Omzi mam zi mam bing bing boo .. ";
-    char cursor = '_';
-    auto text = text_engine.createText(font.get(0), str + cursor);
+    auto glyph_atlas = renderer.createGlyphAtlas();
+    auto draw_list = renderer.createDrawList();
+    draw_list.reserve(64);
+    // The document lives on the model thread; this thread pumps events and draws its frames.
+    const uint32_t file_event = SDL_RegisterEvents(2);
+    const uint32_t frame_event = file_event + 1;
+    using totpad::Model;
+    jobs::Scheduler scheduler;
+    auto model = Model(file_event, frame_event, "Omzi mam zi mam bing bing boo .. ", &scheduler);
+    auto& frames = model.frames();
+    frames.update();
+    auto view = totpad::BasicTextView<totpad::Frame>(text_engine, *font, frames.front());
+    uint64_t shown = 0, applied = 0;
+    size_t sent_top = 0, sent_rows = 0;
+    bool highlighted = false;
+
+    struct Dialog {
+        uint32_t type;
+        int32_t code;
+    } open_dialog{file_event, Model::Open}, save_dialog{file_event, Model::Save};
+    SDL_DialogFileCallback chosen = [](void* userdata, const char* const* files, int) {
+        auto dialog = static_cast<const Dialog*>(userdata);
+        if (!dialog->type || !files || !files[0]) return;
+        SDL_Event event{};
+        event.type = dialog->type;
+        event.user.code = dialog->code;
+        event.user.data1 = SDL_strdup(files[0]);
+        SDL_PushEvent(&event);
+    };
     float text_padding = 10.0f;
-    text.setWrapWidth(gui.viewport.width - text_padding);
+    auto view_area = [&] {
+        return RectF{
+            text_padding,
+            text_padding,
+            gui.viewport.width - 2 * text_padding,
+            gui.viewport.height - 2 * text_padding - font->lineSkip()
+        };
+    };
+    auto resize = [&] {
+        view.resize(size<int> {
+            gui.viewport.width - static_cast<int>(2 * text_padding),
+            gui.viewport.height - static_cast<int>(2 * text_padding) - font->lineSkip()
+        });
+    };
+    resize();
+    view.moveCaret(frames.front().caret);
+    if (file) model.open(file);
 
     events.startTextInput(window);
     window.show();
-    SDL_Event event;
+#ifdef PROFILE
+    auto overlay = profile::Overlay(text_engine, *font);
+    overlay.budget_ms = pacer.getPeriod() / static_cast<float>(SDL_NS_PER_MS);
+    bool show_overlay = false;
+#endif
+    std::vector<SDL_Event> batch;
+    batch.reserve(64);
     while (gui.running) {
-        auto itime = SDL_GetTicks();
+        events.pump(batch);
+        pacer.begin();
 
-        events.waitEvent(event);
+        profile_zone("frame");
+        for (auto& event : batch) {
+            profile_zone("event");
             switch (event.type)
             {
-                CASE (SDL_EVENT_TEXT_INPUT,
-                    str += event.text.text;
-                    text.setText(str + cursor);
-                )
                 CASE (SDL_EVENT_KEY_DOWN,
-                    // gui.keys[event.key.key] = true;
-
-                    if (event.key.key == SDLK_BACKSPACE) {
-                        if (!str.empty()) {
-                            str.pop_back();
-                            text.setText(str + cursor);
+                    const bool command = event.key.mod & (SDL_KMOD_CTRL | SDL_KMOD_GUI);
+                    if (command && event.key.key == SDLK_O) {
+                        window.showOpenFileDialog(chosen, &open_dialog);
+                    } else if (command && event.key.key == SDLK_S && frames.front().path.empty()) {
+                        window.showSaveFileDialog(chosen, &save_dialog);
+                    } else if (event.key.key == SDLK_PAGEUP) {
+                        view.page(-1);
+                    } else if (event.key.key == SDLK_PAGEDOWN) {
+                        view.page(1);
+                    }
+#ifdef PROFILE
+                    else if (event.key.key == SDLK_F3) {
+                        show_overlay = !show_overlay;
+                        renderer.damageAll();
+                    } else if (event.key.key == SDLK_F12) {
+                        if (!profile::exportChromeTrace("totpad-trace.json")) {
+                            debug_log("Trace export failed: %s", SDL_GetError());
                         }
-                    } else if (event.key.key == 13) {
-                        str += '\n';
-                        text.setText(str + cursor);
                     }
+#endif
+                    else model.post(event);
+                )
+                CASE (SDL_EVENT_TEXT_INPUT,
+                    model.post(event);
+                )
+                CASE (SDL_EVENT_MOUSE_WHEEL,
+                    view.scroll(-event.wheel.y * 3 * font->lineSkip());
                 )
-                // CASE (SDL_EVENT_KEY_UP,
-                    // gui.keys[event.key.key] = false;
-                // )
-                // CASE (SDL_EVENT_MOUSE_MOTION,
-                //     gui.cursor.x = event.motion.x;
-                //     gui.cursor.y = event.motion.y;
-                // )
                 CASE (SDL_EVENT_WINDOW_RESIZED,
                     gui.viewport.width = event.window.data1;
                     gui.viewport.height = event.window.data2;
-                    text.setWrapWidth(gui.viewport.width - text_padding);
+                    resize();
                 )
                 CASE (SDL_EVENT_WINDOW_DISPLAY_SCALE_CHANGED,
                     gui.scale = window.scale();
-                    font.scale(gui.scale);
+                    font = fonts.get("Raleway-Black.ttf", 24.0f, dpi());
+                    glyph_atlas.clear();
+                    view.setFont(*font);
+#ifdef PROFILE
+                    overlay.setFont(*font);
+#endif
+                    resize();
+                )
+                CASE (SDL_EVENT_WINDOW_EXPOSED,
+                    renderer.damageAll();
                 )
                 CASE (SDL_EVENT_WINDOW_CLOSE_REQUESTED,
                     gui.running = false;
                 )
+                CASE (SDL_EVENT_DROP_FILE,
+                    if (event.drop.data) model.open(event.drop.data);
+                )
+                default:
+                    if (event.type == file_event) {
+                        model.post(event);
+                        if (event.user.data1) SDL_free(event.user.data1);
+                    }
             }
+        }
+
+        // Take the newest frame: replay its edits into the layout, then pick up its text.
+        if (frames.update()) {
+            profile_zone("sync");
+            const totpad::Frame& frame = frames.front();
+            view.setSource(frame);
+            if (frame.document != shown) {
+                shown = frame.document;
+                applied = frame.revision;
+                view.reset();
+            }
+            for (auto& edit : frame.edits) {
+                if (edit.revision <= applied) continue;
+                view.edited(edit.change.line, edit.change.old_lines, edit.change.new_lines, edit.change.caret);
+            }
+            applied = frame.revision;
+            model.acknowledge(applied);
+            view.sync();
+            if (view.caret() != frame.caret) view.moveCaret(frame.caret);
+            if (frame.title != gui.title) {
+                gui.title = frame.title;
+                window.setTitle(gui.title);
+            }
+            if (frame.finding || highlighted) renderer.damage(view_area());
+        }
+        const totpad::Frame& frame = frames.front();
 
         // RENDER
 
-            renderer.clear(Color{0, 0, 0, 255});
+            {
+                profile_zone("layout");
+                renderer.damage(view.damage(position{text_padding, text_padding}));
+            }
+            const size_t rows = static_cast<size_t>(view_area().height / std::max(font->lineSkip(), 1)) + 1;
+            if (view.top() != sent_top || rows != sent_rows) {
+                sent_top = view.top();
+                sent_rows = rows;
+                model.view(sent_top, sent_rows);
+            }
+
+            RectF status_area{
+                text_padding,
+                gui.viewport.height - text_padding - font->lineSkip(),
+                gui.viewport.width - 2 * text_padding,
+                static_cast<float>(font->lineSkip())
+            };
+            if (frame.status != gui.status) {
+                gui.status = frame.status;
+                renderer.damage(status_area);
+            }
 
-            text.draw(position{text_padding, text_padding});
+#ifdef PROFILE
+            RectF overlay_area{gui.viewport.width - 250.0f, 10.0f, 240.0f, 80.0f};
+            if (show_overlay) renderer.damage(overlay_area);
+#endif
 
-            renderer.present();
+            if (renderer.beginFrame(Color{0, 0, 0, 255})) {
+                // Scratch for this frame only, released by endFrame().
+                std::vector<RectF, memory::ArenaAllocator<RectF>> highlights{memory::ArenaAllocator<RectF>(renderer.scratch())};
+                if (frame.finding && !frame.matches.empty()) {
+                    profile_zone("highlight");
+                    view.highlights(position{text_padding, text_padding}, frame.matches, highlights);
+                    draw_list.clear();
+                    for (auto& box : highlights) draw_list.rect(Color{72, 64, 16, 255}, box);
+                    const size_t all = highlights.size();
+                    view.highlights(position{text_padding, text_padding}, frame.current, highlights);
+                    for (size_t i = all; i < highlights.size(); i++) draw_list.rect(Color{160, 128, 32, 255}, highlights[i]);
+                    draw_list.submit();
+                }
+                highlighted = !highlights.empty();
+                {
+                    profile_zone("draw");
+                    // Only queued; drawn by the glyph_atlas.flush() below, together with the status line.
+                    view.draw(position{text_padding, text_padding}, glyph_atlas);
+                }
 
-        // END
+                draw_list.clear();
+                draw_list.rect(Color{16, 16, 16, 255}, status_area);
+                draw_list.line(
+                    position{status_area.x, status_area.y},
+                    position{status_area.x + status_area.width, status_area.y},
+                    Color{48, 48, 48, 255}
+                );
+                draw_list.submit();
+                glyph_atlas.draw(*font, gui.status, position{status_area.x, status_area.y}, Color{128, 128, 128, 255});
+                glyph_atlas.flush();
+#ifdef PROFILE
+                if (show_overlay) overlay.draw(renderer, overlay_area);
+#endif
 
-        auto etime = SDL_GetTicks();
-        if (etime < gui.target_frequency) {
-            SDL_Delay(gui.target_frequency - etime);
-            gui.time = gui.target_frequency;
-        }
-        else {
-            gui.time = etime;
-        }
+                {
+                    profile_zone("present");
+                    renderer.endFrame();
+                }
+                pacer.end();
+                profile_frame(pacer.stats().frame_ms);
+            }
+
+        // END
     }
 }
 
 int main (int argc, char* argv[]) {
     try {
-        code();
+        code(argc > 1 ? argv[1] : nullptr);
     } catch (const std::exception& error) {
         cout << "Error in " << error.what() << endl;
         cout << "   " << SDL_GetError();
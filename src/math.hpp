@@ -1,7 +1,12 @@
 // math.hpp
 #pragma once
 
+#include "simd.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
 #include <cstdint>
+#include <vector>
 
 namespace math {
 
@@ -14,19 +19,59 @@ namespace math {
         constexpr Color() : red(0), green(0), blue(0), alpha(255) {}
         constexpr Color(uint8_t r, uint8_t g, uint8_t b, uint8_t a = 255)
             : red(r), green(g), blue(b), alpha(a) {}
+
+        constexpr bool operator==(const Color& other) const {
+            return red == other.red && green == other.green && blue == other.blue && alpha == other.alpha;
+        }
+        constexpr bool operator!=(const Color& other) const { return !(*this == other); }
     };
 
-    template<typename T>
-    struct Rectangle {
-        T x;
-        T y;
-        T width;
-        T height;
+    namespace detail {
+        // x / 255 rounded, exact for x in [0, 255 * 255].
+        constexpr uint8_t div255(const uint32_t x) {
+            return static_cast<uint8_t>((x + 128 + ((x + 128) >> 8)) >> 8);
+        }
+    } // namespace detail
 
-        constexpr Rectangle() : x(0), y(0), width(0), height(0) {}
-        constexpr Rectangle(T x_, T y_, T w_, T h_)
-            : x(x_), y(y_), width(w_), height(h_) {}
-    };
+    // `source` over `destination`, both with straight (not premultiplied) alpha.
+    constexpr Color blend(const Color& source, const Color& destination) {
+        const uint32_t under = detail::div255(uint32_t(destination.alpha) * (255 - source.alpha));
+        const uint32_t alpha = source.alpha + under;
+        if (!alpha) return Color(0, 0, 0, 0);
+        auto channel = [&](const uint8_t s, const uint8_t d) {
+            return static_cast<uint8_t>((uint32_t(s) * source.alpha + uint32_t(d) * under + alpha / 2) / alpha);
+        };
+        return Color(
+            channel(source.red, destination.red),
+            channel(source.green, destination.green),
+            channel(source.blue, destination.blue),
+            static_cast<uint8_t>(alpha)
+        );
+    }
+    // From `a` at t = 0 to `b` at t = 255.
+    constexpr Color mix(const Color& a, const Color& b, const uint8_t t) {
+        auto channel = [t](const uint8_t x, const uint8_t y) {
+            return detail::div255(uint32_t(x) * (255 - t) + uint32_t(y) * t);
+        };
+        return Color(channel(a.red, b.red), channel(a.green, b.green), channel(a.blue, b.blue), channel(a.alpha, b.alpha));
+    }
+    // Componentwise product, e.g. a texel tinted by a vertex color.
+    constexpr Color modulate(const Color& a, const Color& b) {
+        return Color(
+            detail::div255(uint32_t(a.red) * b.red),
+            detail::div255(uint32_t(a.green) * b.green),
+            detail::div255(uint32_t(a.blue) * b.blue),
+            detail::div255(uint32_t(a.alpha) * b.alpha)
+        );
+    }
+    constexpr Color premultiply(const Color& color) {
+        return Color(
+            detail::div255(uint32_t(color.red) * color.alpha),
+            detail::div255(uint32_t(color.green) * color.alpha),
+            detail::div255(uint32_t(color.blue) * color.alpha),
+            color.alpha
+        );
+    }
 
     namespace d2 {
 
@@ -37,6 +82,16 @@ namespace math {
 
             constexpr position() : x(0), y(0) {}
             constexpr position(T x_, T y_) : x(x_), y(y_) {}
+
+            constexpr position operator+(const position& other) const { return position(x + other.x, y + other.y); }
+            constexpr position operator-(const position& other) const { return position(x - other.x, y - other.y); }
+            constexpr position operator-() const { return position(-x, -y); }
+            constexpr position operator*(const T factor) const { return position(x * factor, y * factor); }
+            constexpr position operator/(const T divisor) const { return position(x / divisor, y / divisor); }
+            constexpr position& operator+=(const position& other) { x += other.x; y += other.y; return *this; }
+            constexpr position& operator-=(const position& other) { x -= other.x; y -= other.y; return *this; }
+            constexpr bool operator==(const position& other) const { return x == other.x && y == other.y; }
+            constexpr bool operator!=(const position& other) const { return !(*this == other); }
         };
 
         template<typename T>
@@ -46,8 +101,234 @@ namespace math {
 
             constexpr size() : width(0), height(0) {}
             constexpr size(T w, T h) : width(w), height(h) {}
+
+            constexpr size operator*(const T factor) const { return size(width * factor, height * factor); }
+            constexpr bool operator==(const size& other) const { return width == other.width && height == other.height; }
+            constexpr bool operator!=(const size& other) const { return !(*this == other); }
         };
 
+        template<typename T>
+        constexpr T dot(const position<T>& a, const position<T>& b) {
+            return a.x * b.x + a.y * b.y;
+        }
+
     } // namespace d2
 
+    // Edges are half-open: a rectangle covers [x, x + width) by [y, y + height).
+    template<typename T>
+    struct Rectangle {
+        T x;
+        T y;
+        T width;
+        T height;
+
+        constexpr Rectangle() : x(0), y(0), width(0), height(0) {}
+        constexpr Rectangle(T x_, T y_, T w_, T h_)
+            : x(x_), y(y_), width(w_), height(h_) {}
+        constexpr Rectangle(const d2::position<T>& origin, const d2::size<T>& extent)
+            : x(origin.x), y(origin.y), width(extent.width), height(extent.height) {}
+
+        constexpr T right() const { return x + width; }
+        constexpr T bottom() const { return y + height; }
+        constexpr d2::position<T> origin() const { return d2::position<T>(x, y); }
+        constexpr d2::size<T> extent() const { return d2::size<T>(width, height); }
+        constexpr bool empty() const { return !(width > 0) || !(height > 0); }
+
+        constexpr bool contains(const d2::position<T>& point) const {
+            return point.x >= x && point.x < right() && point.y >= y && point.y < bottom();
+        }
+        constexpr bool contains(const Rectangle& other) const {
+            return other.x >= x && other.right() <= right() && other.y >= y && other.bottom() <= bottom();
+        }
+        constexpr bool intersects(const Rectangle& other) const {
+            return x < other.right() && other.x < right() && y < other.bottom() && other.y < bottom();
+        }
+        constexpr Rectangle translated(const d2::position<T>& offset) const {
+            return Rectangle(x + offset.x, y + offset.y, width, height);
+        }
+        constexpr bool operator==(const Rectangle& other) const {
+            return x == other.x && y == other.y && width == other.width && height == other.height;
+        }
+        constexpr bool operator!=(const Rectangle& other) const { return !(*this == other); }
+    };
+
+    // The overlap of `a` and `b`; empty, at the clamped corner, when they don't overlap.
+    template<typename T>
+    constexpr Rectangle<T> intersect(const Rectangle<T>& a, const Rectangle<T>& b) {
+        const T left = std::max(a.x, b.x), top = std::max(a.y, b.y);
+        const T right = std::min(a.right(), b.right()), bottom = std::min(a.bottom(), b.bottom());
+        return Rectangle<T>(left, top, std::max(right - left, T(0)), std::max(bottom - top, T(0)));
+    }
+    // The bounds of both; an empty side is ignored.
+    template<typename T>
+    constexpr Rectangle<T> unite(const Rectangle<T>& a, const Rectangle<T>& b) {
+        if (a.empty()) return b;
+        if (b.empty()) return a;
+        const T left = std::min(a.x, b.x), top = std::min(a.y, b.y);
+        return Rectangle<T>(left, top, std::max(a.right(), b.right()) - left, std::max(a.bottom(), b.bottom()) - top);
+    }
+
+    namespace d2 {
+
+        // Affine map x' = a x + c y + tx, y' = b x + d y + ty. `p * q` applies q first.
+        template<typename T>
+        struct transform {
+            T a, b, c, d, tx, ty;
+
+            constexpr transform() : a(1), b(0), c(0), d(1), tx(0), ty(0) {}
+            constexpr transform(T a_, T b_, T c_, T d_, T tx_, T ty_)
+                : a(a_), b(b_), c(c_), d(d_), tx(tx_), ty(ty_) {}
+
+            static constexpr transform translation(const position<T>& offset) {
+                return transform(1, 0, 0, 1, offset.x, offset.y);
+            }
+            static constexpr transform scaling(const T sx, const T sy) {
+                return transform(sx, 0, 0, sy, 0, 0);
+            }
+            static transform rotation(const T radians) {
+                const T cosine = std::cos(radians), sine = std::sin(radians);
+                return transform(cosine, sine, -sine, cosine, 0, 0);
+            }
+
+            constexpr transform operator*(const transform& q) const {
+                return transform(
+                    a * q.a + c * q.b, b * q.a + d * q.b,
+                    a * q.c + c * q.d, b * q.c + d * q.d,
+                    a * q.tx + c * q.ty + tx, b * q.tx + d * q.ty + ty
+                );
+            }
+            constexpr position<T> operator()(const position<T>& p) const {
+                return position<T>(a * p.x + c * p.y + tx, b * p.x + d * p.y + ty);
+            }
+            // Bounds of the mapped corners.
+            constexpr Rectangle<T> operator()(const Rectangle<T>& r) const {
+                const position<T> p0 = (*this)(position<T>(r.x, r.y)), p1 = (*this)(position<T>(r.right(), r.y));
+                const position<T> p2 = (*this)(position<T>(r.x, r.bottom())), p3 = (*this)(position<T>(r.right(), r.bottom()));
+                const T left = std::min(std::min(p0.x, p1.x), std::min(p2.x, p3.x));
+                const T top = std::min(std::min(p0.y, p1.y), std::min(p2.y, p3.y));
+                const T right = std::max(std::max(p0.x, p1.x), std::max(p2.x, p3.x));
+                const T bottom = std::max(std::max(p0.y, p1.y), std::max(p2.y, p3.y));
+                return Rectangle<T>(left, top, right - left, bottom - top);
+            }
+        };
+
+    } // namespace d2
+
+    // Rectangles stored as separate arrays of left, top, right and bottom edges, so culling and
+    // hit-testing compare four or eight of them per instruction.
+    struct Rectangles {
+        std::vector<float> left;
+        std::vector<float> top;
+        std::vector<float> right;
+        std::vector<float> bottom;
+
+        size_t size() const { return left.size(); }
+        void reserve(const size_t count) {
+            left.reserve(count);
+            top.reserve(count);
+            right.reserve(count);
+            bottom.reserve(count);
+        }
+        void clear() {
+            left.clear();
+            top.clear();
+            right.clear();
+            bottom.clear();
+        }
+        void push_back(const Rectangle<float>& r) {
+            left.push_back(r.x);
+            top.push_back(r.y);
+            right.push_back(r.right());
+            bottom.push_back(r.bottom());
+        }
+        Rectangle<float> operator[](const size_t i) const {
+            return Rectangle<float>(left[i], top[i], right[i] - left[i], bottom[i] - top[i]);
+        }
+    };
+
+    namespace detail {
+        inline bool overlaps(const Rectangles& batch, const size_t i, const Rectangle<float>& area) {
+            return batch.left[i] < area.right() && area.x < batch.right[i] && batch.top[i] < area.bottom() && area.y < batch.bottom[i];
+        }
+        inline bool covers(const Rectangles& batch, const size_t i, const d2::position<float> point) {
+            return point.x >= batch.left[i] && point.x < batch.right[i] && point.y >= batch.top[i] && point.y < batch.bottom[i];
+        }
+#ifdef SIMD_SSE2
+        inline void cull_sse2(const Rectangles& batch, const Rectangle<float>& area, std::vector<uint32_t>& out, size_t& done) {
+            const __m128 x0 = _mm_set1_ps(area.x), y0 = _mm_set1_ps(area.y);
+            const __m128 x1 = _mm_set1_ps(area.right()), y1 = _mm_set1_ps(area.bottom());
+            size_t i = 0;
+            for (; i + 4 <= batch.size(); i += 4) {
+                const __m128 inside = _mm_and_ps(
+                    _mm_and_ps(_mm_cmplt_ps(_mm_loadu_ps(&batch.left[i]), x1), _mm_cmplt_ps(x0, _mm_loadu_ps(&batch.right[i]))),
+                    _mm_and_ps(_mm_cmplt_ps(_mm_loadu_ps(&batch.top[i]), y1), _mm_cmplt_ps(y0, _mm_loadu_ps(&batch.bottom[i])))
+                );
+                for (uint32_t mask = static_cast<uint32_t>(_mm_movemask_ps(inside)); mask; mask &= mask - 1)
+                    out.push_back(static_cast<uint32_t>(i + simd::detail::lowest(mask)));
+            }
+            done = i;
+        }
+        // Scans from the back, four at a time, for the last rectangle containing `point`.
+        inline size_t hit_sse2(const Rectangles& batch, const d2::position<float> point, size_t& done) {
+            const __m128 x = _mm_set1_ps(point.x), y = _mm_set1_ps(point.y);
+            size_t i = batch.size();
+            for (; i >= 4; i -= 4) {
+                const size_t at = i - 4;
+                const __m128 inside = _mm_and_ps(
+                    _mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(&batch.left[at]), x), _mm_cmplt_ps(x, _mm_loadu_ps(&batch.right[at]))),
+                    _mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(&batch.top[at]), y), _mm_cmplt_ps(y, _mm_loadu_ps(&batch.bottom[at])))
+                );
+                const int mask = _mm_movemask_ps(inside);
+                if (mask) {
+                    done = i;
+                    return at + (mask & 8 ? 3 : mask & 4 ? 2 : mask & 2 ? 1 : 0);
+                }
+            }
+            done = i;
+            return batch.size();
+        }
+#endif
+#ifdef SIMD_AVX2
+        simd_avx2 inline void cull_avx2(const Rectangles& batch, const Rectangle<float>& area, std::vector<uint32_t>& out, size_t& done) {
+            const __m256 x0 = _mm256_set1_ps(area.x), y0 = _mm256_set1_ps(area.y);
+            const __m256 x1 = _mm256_set1_ps(area.right()), y1 = _mm256_set1_ps(area.bottom());
+            size_t i = 0;
+            for (; i + 8 <= batch.size(); i += 8) {
+                const __m256 inside = _mm256_and_ps(
+                    _mm256_and_ps(_mm256_cmp_ps(_mm256_loadu_ps(&batch.left[i]), x1, _CMP_LT_OQ), _mm256_cmp_ps(x0, _mm256_loadu_ps(&batch.right[i]), _CMP_LT_OQ)),
+                    _mm256_and_ps(_mm256_cmp_ps(_mm256_loadu_ps(&batch.top[i]), y1, _CMP_LT_OQ), _mm256_cmp_ps(y0, _mm256_loadu_ps(&batch.bottom[i]), _CMP_LT_OQ))
+                );
+                for (uint32_t mask = static_cast<uint32_t>(_mm256_movemask_ps(inside)); mask; mask &= mask - 1)
+                    out.push_back(static_cast<uint32_t>(i + simd::detail::lowest(mask)));
+            }
+            done = i;
+        }
+#endif
+    } // namespace detail
+
+    // Appends the indices of the rectangles in `batch` that overlap `area`, in order; returns
+    // how many were appended.
+    inline size_t cull(const Rectangles& batch, const Rectangle<float>& area, std::vector<uint32_t>& out) {
+        const size_t before = out.size();
+        size_t i = 0;
+#if defined(SIMD_AVX2)
+        if (simd::detail::avx2()) detail::cull_avx2(batch, area, out, i);
+        else detail::cull_sse2(batch, area, out, i);
+#elif defined(SIMD_SSE2)
+        detail::cull_sse2(batch, area, out, i);
+#endif
+        for (; i < batch.size(); i++) if (detail::overlaps(batch, i, area)) out.push_back(static_cast<uint32_t>(i));
+        return out.size() - before;
+    }
+    // Index of the last, i.e. topmost, rectangle in `batch` containing `point`, or batch.size().
+    inline size_t hit(const Rectangles& batch, const d2::position<float> point) {
+        size_t i = batch.size();
+#ifdef SIMD_SSE2
+        const size_t found = detail::hit_sse2(batch, point, i);
+        if (found != batch.size()) return found;
+#endif
+        while (i-- > 0) if (detail::covers(batch, i, point)) return i;
+        return batch.size();
+    }
+
 } // namespace math
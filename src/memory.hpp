@@ -0,0 +1,195 @@
+// memory.hpp
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace memory {
+
+    // Linear allocator for scratch memory that all dies at once, e.g. everything built while
+    // drawing one frame. allocate() bumps a pointer; reset() frees everything. When a round
+    // overflowed into extra blocks, reset() replaces them with one block as large as all of
+    // them, so a steady workload stops allocating after the first few rounds.
+    class Arena {
+        public:
+        explicit Arena(const size_t block = size_t(64) << 10): block(block) {}
+        Arena(Arena&&) = default;
+        Arena& operator=(Arena&&) = default;
+
+        void* allocate(const size_t bytes, const size_t align = alignof(std::max_align_t)) {
+            if (!blocks.empty()) {
+                Block& current = blocks.back();
+                // Align the address, not the offset: blocks only come with new[]'s alignment.
+                const uintptr_t base = reinterpret_cast<uintptr_t>(current.data.get());
+                const size_t start = ((base + current.used + align - 1) & ~uintptr_t(align - 1)) - base;
+                if (start + bytes <= current.capacity) {
+                    current.used = start + bytes;
+                    return current.data.get() + start;
+                }
+            }
+            grow(bytes + align);
+            Block& current = blocks.back();
+            const size_t start = (reinterpret_cast<uintptr_t>(current.data.get()) + align - 1) & ~(align - 1);
+            current.used = start - reinterpret_cast<uintptr_t>(current.data.get()) + bytes;
+            return reinterpret_cast<void*>(start);
+        }
+        // Never destroyed, so only for types that don't need it.
+        template<typename T, typename... Args>
+        T* make(Args&&... args) {
+            static_assert(std::is_trivially_destructible<T>::value, "Arena never runs destructors");
+            return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        }
+        std::string_view copy(const std::string_view text) {
+            if (text.empty()) return std::string_view();
+            char* data = static_cast<char*>(allocate(text.size(), 1));
+            std::memcpy(data, text.data(), text.size());
+            return std::string_view(data, text.size());
+        }
+        void reset() {
+            if (blocks.size() > 1) {
+                size_t total = 0;
+                for (auto& current : blocks) total += current.capacity;
+                blocks.clear();
+                grow(total);
+            }
+            if (!blocks.empty()) blocks.back().used = 0;
+        }
+        // Bytes handed out since the last reset, including alignment padding.
+        size_t used() const {
+            size_t total = 0;
+            for (auto& current : blocks) total += current.used;
+            return total;
+        }
+        size_t capacity() const {
+            size_t total = 0;
+            for (auto& current : blocks) total += current.capacity;
+            return total;
+        }
+
+        private:
+        struct Block {
+            std::unique_ptr<char[]> data;
+            size_t capacity;
+            size_t used;
+        };
+        size_t block;
+        std::vector<Block> blocks;
+
+        void grow(const size_t bytes) {
+            const size_t capacity = std::max(block, bytes);
+            blocks.push_back(Block{std::unique_ptr<char[]>(new char[capacity]), capacity, 0});
+        }
+    };
+
+    // Standard allocator drawing from an Arena; deallocation is a no-op. Containers using it
+    // must not outlive the arena's next reset().
+    //     std::vector<int, memory::ArenaAllocator<int>> scratch{memory::ArenaAllocator<int>(arena)};
+    template<typename T>
+    class ArenaAllocator {
+        public:
+        using value_type = T;
+        explicit ArenaAllocator(Arena& arena): arena(&arena) {}
+        template<typename U>
+        ArenaAllocator(const ArenaAllocator<U>& other): arena(other.arena) {}
+        T* allocate(const size_t count) {
+            return static_cast<T*>(arena->allocate(count * sizeof(T), alignof(T)));
+        }
+        void deallocate(T*, size_t) {}
+        template<typename U>
+        bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+        template<typename U>
+        bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+        private:
+        template<typename U> friend class ArenaAllocator;
+        Arena* arena;
+    };
+
+    // Fixed-size slots for objects of one type, carved out of slabs and recycled through a free
+    // list, so creating and destroying wrappers doesn't go through the heap once warmed up.
+    // Objects come back as Ptr, which returns the slot on destruction; the pool must outlive them.
+    // Not thread-safe.
+    template<typename T>
+    class Pool {
+        public:
+        class Deleter {
+            public:
+            Deleter() = default;
+            explicit Deleter(Pool& pool): pool(&pool) {}
+            void operator()(T* object) const {
+                object->~T();
+                pool->deallocate(object);
+            }
+            private:
+            Pool* pool = nullptr;
+        };
+        using Ptr = std::unique_ptr<T, Deleter>;
+
+        explicit Pool(const size_t slab = 64): slab(std::max<size_t>(slab, 1)) {}
+        Pool(const Pool&) = delete;
+        Pool& operator=(const Pool&) = delete;
+
+        template<typename... Args>
+        Ptr make(Args&&... args) {
+            return emplace([&](void* slot) { return new (slot) T(std::forward<Args>(args)...); });
+        }
+        // For types only a friend can construct: `construct(slot)` placement-news the object
+        // into `slot` and returns it. The slot is given back if that throws.
+        template<typename Construct>
+        Ptr emplace(Construct&& construct) {
+            void* slot = allocate();
+            try {
+                return Ptr(construct(slot), Deleter(*this));
+            } catch (...) {
+                deallocate(slot);
+                throw;
+            }
+        }
+        // Objects alive right now.
+        size_t size() const {
+            return live;
+        }
+        size_t capacity() const {
+            return slabs.size() * slab;
+        }
+
+        private:
+        union Slot {
+            Slot* next;
+            alignas(T) unsigned char storage[sizeof(T)];
+        };
+        size_t slab;
+        std::vector<std::unique_ptr<Slot[]>> slabs;
+        Slot* free = nullptr;
+        size_t live = 0;
+
+        void* allocate() {
+            if (!free) {
+                slabs.emplace_back(new Slot[slab]);
+                Slot* slots = slabs.back().get();
+                for (size_t i = slab; i-- > 0;) {
+                    slots[i].next = free;
+                    free = &slots[i];
+                }
+            }
+            Slot* slot = free;
+            free = slot->next;
+            live++;
+            return slot;
+        }
+        void deallocate(void* object) {
+            Slot* slot = static_cast<Slot*>(object);
+            slot->next = free;
+            free = slot;
+            live--;
+        }
+    };
+
+} // namespace memory
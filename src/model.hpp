@@ -0,0 +1,432 @@
+// model.hpp
+#pragma once
+
+#include "sdl.hpp"
+#include "document.hpp"
+#include "history.hpp"
+#include "search.hpp"
+#include "file.hpp"
+#include "simd.hpp"
+#include "triple.hpp"
+#include "profile.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace totpad {
+
+    // What the render thread draws: the document lines around the view, the caret, the
+    // visible search matches and the status text, plus the edits since earlier frames so
+    // the view can keep its layout. Answers the line queries TextView makes; lines outside
+    // the window read as empty and start past the end, so no caret or match lands on them.
+    struct Frame {
+        struct Edit {
+            uint64_t revision;
+            History::Change change;
+        };
+        // Bumped whenever a file replaces the document.
+        uint64_t document = 0;
+        uint64_t revision = 0;
+        std::vector<Edit> edits;
+        size_t bytes = 0;
+        size_t count = 1;
+        size_t first = 0;
+        std::vector<std::string> text;
+        std::vector<size_t> starts;
+        size_t caret = 0;
+        std::vector<Search::Match> matches;
+        // The match the caret was moved to, if any.
+        std::vector<Search::Match> current;
+        bool finding = false;
+        std::string path;
+        std::string title;
+        std::string status;
+
+        size_t lines() const { return count; }
+        size_t size() const { return bytes; }
+        std::string line(size_t index) const {
+            return held(index) ? text[index - first] : std::string();
+        }
+        void line(size_t index, std::string& out) const {
+            if (held(index)) out.assign(text[index - first]);
+            else out.clear();
+        }
+        size_t lineStart(size_t index) const {
+            return held(index) ? starts[index - first] : bytes + 1;
+        }
+        size_t lineEnd(size_t index) const {
+            return held(index) ? starts[index - first] + text[index - first].size() : bytes + 1;
+        }
+        size_t lineOf(size_t offset) const {
+            if (text.empty()) return first;
+            const size_t i = static_cast<size_t>(std::upper_bound(starts.begin(), starts.end(), offset) - starts.begin());
+            return first + (i ? i - 1 : 0);
+        }
+        private:
+        bool held(size_t index) const {
+            return index >= first && index - first < text.size();
+        }
+    };
+
+    // Owns the document and everything that edits it, on a thread of its own. SDL wants events
+    // pumped and the renderer driven from the main thread, so that thread stays the render
+    // thread: it post()s input here and draws whichever Frame was published last. Typing is
+    // applied while a frame renders or waits for vsync, and each frame shows every edit made
+    // before it started.
+    class Model {
+        public:
+        enum : int32_t { Wake, Open, Save };
+
+        // Loader, saver, search and file dialog results are events of type `file_event`, to be
+        // posted back here. Every published frame pushes a `frame_event` to wake the render thread.
+        // Large files are indexed on `scheduler` when there is one.
+        Model(const uint32_t file_event, const uint32_t frame_event, std::string text, jobs::Scheduler* scheduler = nullptr)
+            : document(std::move(text)), loader(file_event, scheduler), saver(file_event), search(file_event),
+              file_event(file_event), frame_event(frame_event) {
+            caret = document.size();
+            publish();
+            worker = std::thread([this] { run(); });
+        }
+        Model(const Model&) = delete;
+        Model& operator=(const Model&) = delete;
+        ~Model() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                quit = true;
+            }
+            ready.notify_one();
+            worker.join();
+        }
+
+        // Queues an event for the model thread. The text of text input and file events is
+        // copied, so the event may be freed afterwards.
+        void post(const SDL_Event& event) {
+            Input input{event, std::string()};
+            if (event.type == SDL_EVENT_TEXT_INPUT && event.text.text) input.text = event.text.text;
+            else if (event.type == file_event && event.user.data1) input.text = static_cast<const char*>(event.user.data1);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                inbox.push_back(std::move(input));
+            }
+            ready.notify_one();
+        }
+        void open(const std::string& path) {
+            SDL_Event event{};
+            event.type = file_event;
+            event.user.code = Open;
+            event.user.data1 = const_cast<char*>(path.c_str());
+            post(event);
+        }
+        // Where the render thread's view is: its top line and how many lines fit in it.
+        void view(const size_t top, const size_t rows) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                view_top = top;
+                view_rows = std::max<size_t>(rows, 1);
+                moved = true;
+            }
+            ready.notify_one();
+        }
+        // The render thread has applied the edits of frames up to `revision`.
+        void acknowledge(const uint64_t revision) {
+            acknowledged = revision;
+        }
+        TripleBuffer<Frame>& frames() {
+            return buffer;
+        }
+
+        private:
+        struct Input {
+            SDL_Event event;
+            std::string text;
+        };
+        Document document;
+        History history;
+        Loader loader;
+        Saver saver;
+        Search search;
+        uint32_t file_event;
+        uint32_t frame_event;
+        std::thread worker;
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::deque<Input> inbox;
+        bool quit = false;
+        bool moved = false;
+        size_t view_top = 0;
+        size_t view_rows = 1;
+        std::atomic<uint64_t> acknowledged{0};
+        TripleBuffer<Frame> buffer;
+
+        // Model thread state.
+        size_t caret = 0;
+        std::string path;
+        std::string message;
+        // Find bar: the query, the match the caret was moved to, and a pending next (1) or
+        // previous (-1) jump waiting for the search to get that far.
+        bool finding = false;
+        bool regex = false;
+        std::string query;
+        size_t current = Search::npos;
+        int seek = 0;
+        uint64_t generation = 0;
+        uint64_t revision = 0;
+        std::vector<Frame::Edit> edits;
+        // Whether the caret moved since the last frame, which then centers on it.
+        bool reveal = true;
+        bool edited = false;
+        size_t top = 0;
+        size_t rows = 1;
+        // Lines the last frame holds.
+        size_t window_first = 0;
+        size_t window_size = 0;
+
+        void run() {
+            std::deque<Input> batch;
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!quit) {
+                ready.wait(lock, [this] { return quit || moved || !inbox.empty(); });
+                if (quit) break;
+                batch.swap(inbox);
+                const bool scrolled = moved;
+                moved = false;
+                top = view_top;
+                rows = view_rows;
+                lock.unlock();
+
+                profile_zone("model");
+                bool changed = false;
+                edited = false;
+                for (auto& input : batch) changed |= handle(input);
+                batch.clear();
+                changed |= poll();
+                if (changed || (scrolled && !covered())) publish();
+                lock.lock();
+            }
+        }
+        // Whether the last frame's window still holds a screenful of margin around the view.
+        bool covered() const {
+            const size_t end = window_first + window_size;
+            return (window_first == 0 || top >= window_first + rows) && (end >= document.lines() || top + 2 * rows <= end);
+        }
+        void log(const History::Change& value) {
+            edits.push_back(Frame::Edit{++revision, value});
+        }
+        void change(const History::Change& value) {
+            log(value);
+            caret = value.caret;
+            reveal = true;
+            edited = true;
+        }
+        void moveCaret(const size_t value) {
+            caret = value;
+            reveal = true;
+        }
+        void find() {
+            search.start(document, finding ? query : std::string(), regex);
+            current = Search::npos;
+            seek = 0;
+        }
+        // Moves the caret to the next or previous match, or waits for one the scan hasn't reached.
+        void go(const int direction) {
+            const size_t i = direction > 0 ? search.next(caret) : search.previous(caret);
+            const auto& matches = search.matches();
+            const bool wrapped = i == Search::npos || (direction > 0 ? matches[i].offset <= caret : matches[i].offset >= caret);
+            seek = wrapped && search.busy() ? direction : 0;
+            if (seek || i == Search::npos) return;
+            current = i;
+            history.seal();
+            moveCaret(matches[i].offset);
+        }
+        void load(const std::string& file) {
+            try {
+                loader.open(document, file);
+            } catch (const std::exception&) {
+                message = "Could not open " + file;
+                debug_log("Open failed: %s", SDL_GetError());
+                return;
+            }
+            path = file;
+            message.clear();
+            history.clear();
+            edits.clear();
+            generation++;
+            caret = 0;
+            reveal = true;
+            if (finding) find();
+        }
+        void save(const std::string& file) {
+            if (document.pending()) {
+                message = "Can't save while indexing";
+                return;
+            }
+            path = file;
+            message = "Saving";
+            saver.save(document, file);
+        }
+        // Applies one input event; returns whether anything visible changed.
+        bool handle(const Input& input) {
+            const SDL_Event& event = input.event;
+            const bool editable = !document.pending();
+            if (event.type == SDL_EVENT_TEXT_INPUT) {
+                if (finding) {
+                    query += input.text;
+                    find();
+                }
+                // Read-only until a large file is fully indexed.
+                else if (editable) change(history.insert(document, caret, input.text, true));
+                return true;
+            }
+            if (event.type == file_event) {
+                if (event.user.code == Open && !input.text.empty()) load(input.text);
+                else if (event.user.code == Save && !input.text.empty()) save(input.text);
+                return event.user.code != Wake;
+            }
+            if (event.type != SDL_EVENT_KEY_DOWN) return false;
+            const SDL_Keycode key = event.key.key;
+            const bool command = event.key.mod & (SDL_KMOD_CTRL | SDL_KMOD_GUI);
+            if (command && key == SDLK_F) {
+                finding = true;
+                find();
+            } else if (finding && key == SDLK_ESCAPE) {
+                finding = false;
+                find();
+            } else if (finding && command && key == SDLK_R) {
+                regex = !regex;
+                find();
+            } else if (finding && key == SDLK_BACKSPACE) {
+                if (query.empty()) return false;
+                query.erase(simd::previous(query.data(), query.size()));
+                find();
+            } else if (finding && key == 13) {
+                go(event.key.mod & SDL_KMOD_SHIFT ? -1 : 1);
+            } else if (command && (key == SDLK_Z || key == SDLK_Y)) {
+                const bool redo = key == SDLK_Y || (event.key.mod & SDL_KMOD_SHIFT);
+                if (!editable || !(redo ? history.canRedo() : history.canUndo())) return false;
+                change(redo ? history.redo(document) : history.undo(document));
+            } else if (command && key == SDLK_S) {
+                if (path.empty()) return false;
+                save(path);
+            } else if (key == SDLK_BACKSPACE) {
+                if (!caret || !editable) return false;
+                const size_t start = document.previous(caret);
+                change(history.erase(document, start, caret - start, true));
+            } else if (key == 13) {
+                if (!editable) return false;
+                change(history.insert(document, caret, "\n", true));
+            } else if (key == SDLK_LEFT) {
+                history.seal();
+                moveCaret(document.previous(caret));
+            } else if (key == SDLK_RIGHT) {
+                history.seal();
+                moveCaret(document.next(caret));
+            } else return false;
+            return true;
+        }
+        // Takes in background results; returns whether anything visible changed.
+        bool poll() {
+            bool changed = false;
+            if (loader.busy()) {
+                const size_t lines = document.lines();
+                if (loader.update(document)) {
+                    log(History::Change{lines - 1, 1, document.lines() - lines + 1, caret});
+                    changed = true;
+                }
+                // Searching a file that is still loading would restart per chunk; wait for the end.
+                edited |= !loader.busy();
+            }
+            // Match offsets go stale with every edit, so the search starts over on a new snapshot.
+            if (edited && finding) find();
+            if (search.update()) {
+                changed = true;
+                if (seek) go(seek);
+            }
+            switch (saver.poll()) {
+                case Saver::State::Saved: message = "Saved"; changed = true; break;
+                case Saver::State::Failed: message = "Save failed: " + saver.error(); changed = true; break;
+                default: break;
+            }
+            return changed;
+        }
+        void publish() {
+            profile_zone("publish");
+            Frame& frame = buffer.back();
+            // Edits the render thread has applied are not needed any more.
+            const uint64_t applied = acknowledged;
+            edits.erase(edits.begin(), std::find_if(edits.begin(), edits.end(),
+                [applied](const Frame::Edit& edit) { return edit.revision > applied; }));
+            frame.document = generation;
+            frame.revision = revision;
+            frame.edits.assign(edits.begin(), edits.end());
+            frame.bytes = document.size();
+            frame.count = document.lines();
+            frame.caret = caret;
+
+            // A window of two screenfuls either side of the view, or of the caret when it moved.
+            const size_t center = reveal ? document.lineOf(caret) : top;
+            reveal = false;
+            window_first = center > 2 * rows ? center - 2 * rows : 0;
+            window_size = std::min(frame.count, center + 2 * rows + 2) - window_first;
+            frame.first = window_first;
+            frame.text.resize(window_size);
+            frame.starts.resize(window_size);
+            for (size_t i = 0; i < window_size; i++) {
+                document.line(window_first + i, frame.text[i]);
+                frame.starts[i] = document.lineStart(window_first + i);
+            }
+
+            frame.matches.clear();
+            frame.current.clear();
+            frame.finding = finding;
+            if (finding && window_size) {
+                const auto& matches = search.matches();
+                const size_t from = frame.starts.front();
+                const size_t to = frame.starts.back() + frame.text.back().size();
+                auto match = std::lower_bound(matches.begin(), matches.end(), from,
+                    [](const Search::Match& m, size_t at) { return m.offset + m.length <= at; });
+                for (; match != matches.end() && match->offset < to; ++match) frame.matches.push_back(*match);
+                if (current < matches.size()) frame.current.push_back(matches[current]);
+            }
+
+            // Built in place: the slots keep their capacity, so steady frames don't allocate.
+            frame.path = path;
+            const size_t slash = path.find_last_of("/\\");
+            if (path.empty()) frame.title = "Totpad";
+            else frame.title.assign(path, slash == std::string::npos ? 0 : slash + 1).append(" - Totpad");
+            status(frame.status);
+            buffer.publish();
+            if (frame_event) {
+                SDL_Event event{};
+                event.type = frame_event;
+                SDL_PushEvent(&event);
+            }
+        }
+        void status(std::string& text) const {
+            if (finding) {
+                text.assign(regex ? "Find regex: " : "Find: ").append(query).append("  -  ");
+                const size_t count = search.matches().size();
+                if (search.failed()) text += "invalid pattern";
+                else if (current < count) text.append(std::to_string(current + 1)).append(" of ").append(std::to_string(count));
+                else text.append(std::to_string(count)).append(" matches");
+                if (search.busy()) text += ", searching";
+                return;
+            }
+            const size_t line = document.lineOf(caret);
+            size_t column = 1;
+            document.read(document.lineStart(line), caret - document.lineStart(line),
+                [&column](const char* data, size_t n) { column += simd::codepoints(data, n); });
+            text.assign("Ln ").append(std::to_string(line + 1)).append(", Col ").append(std::to_string(column));
+            if (document.pending()) text.append("  -  indexing ").append(std::to_string(
+                document.size() * 100 / (document.size() + document.pending())
+            )).append("%");
+            if (loader.invalid()) text += "  -  not UTF-8";
+            if (!message.empty()) text.append("  -  ").append(message);
+        }
+    };
+
+} // namespace totpad
@@ -0,0 +1,206 @@
+#include "assets.hpp"
+#include <iostream>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+using std::cout, std::cerr, std::endl;
+
+// Writes asset bundles for assets::Bundle:
+//     pack [--lz4] [-C directory] output.pak file...
+//     pack --list bundle.pak
+// Files are read from `directory` (default: the working directory) and stored under the
+// name given on the command line. With --lz4, entries that shrink are LZ4 compressed; fonts
+// and images that are left stored are mapped zero-copy at runtime.
+
+// Greedy single-probe LZ4 block compressor. Ratio is below the reference encoder's fast mode,
+// which is fine for assets packed once at build time.
+inline std::vector<char> compress(const char* source, const size_t size) {
+    auto in = reinterpret_cast<const unsigned char*>(source);
+    std::vector<char> out;
+    out.reserve(size + size / 255 + 16);
+    auto length = [&out](size_t value) {
+        for (; value >= 255; value -= 255) out.push_back(static_cast<char>(255));
+        out.push_back(static_cast<char>(value));
+    };
+    auto sequence = [&](size_t anchor, size_t literals, size_t offset, size_t match) {
+        const size_t extra = match ? match - 4 : 0;
+        out.push_back(static_cast<char>((std::min<size_t>(literals, 15) << 4) | std::min<size_t>(extra, 15)));
+        if (literals >= 15) length(literals - 15);
+        out.insert(out.end(), source + anchor, source + anchor + literals);
+        if (!match) return;
+        out.push_back(static_cast<char>(offset & 0xFF));
+        out.push_back(static_cast<char>(offset >> 8));
+        if (extra >= 15) length(extra - 15);
+    };
+    auto read32 = [in](size_t i) {
+        uint32_t value;
+        std::memcpy(&value, in + i, 4);
+        return value;
+    };
+
+    // The format requires the last match to start 12 bytes and end 5 bytes before the end.
+    const size_t limit = size > 12 ? size - 12 : 0;
+    std::vector<uint32_t> table(1 << 16, 0);
+    size_t anchor = 0, i = 0;
+    while (i < limit) {
+        const uint32_t bytes = read32(i);
+        const uint32_t slot = (bytes * 2654435761u) >> 16;
+        const size_t candidate = table[slot];
+        table[slot] = static_cast<uint32_t>(i + 1);
+        if (candidate && i - (candidate - 1) <= 65535 && read32(candidate - 1) == bytes) {
+            const size_t from = candidate - 1;
+            size_t match = 4;
+            while (i + match < size - 5 && in[from + match] == in[i + match]) match++;
+            sequence(anchor, i - anchor, i - from, match);
+            i += match;
+            anchor = i;
+        }
+        else i++;
+    }
+    sequence(anchor, size - anchor, 0, 0);
+    return out;
+}
+
+struct Input {
+    std::string name;
+    std::vector<char> data;
+    assets::bundle::Entry entry;
+};
+
+inline std::vector<char> load(const std::string& path) {
+    size_t size;
+    void* data = SDL_LoadFile(path.c_str(), &size);
+    if (!data) throw_error;
+    std::vector<char> bytes(static_cast<char*>(data), static_cast<char*>(data) + size);
+    SDL_free(data);
+    return bytes;
+}
+
+inline void write(const char* output, std::vector<Input>& inputs, const bool lz4) {
+    using namespace assets;
+    std::sort(inputs.begin(), inputs.end(), [](const Input& a, const Input& b) { return a.name < b.name; });
+    for (size_t i = 1; i < inputs.size(); i++) {
+        if (inputs[i].name == inputs[i - 1].name) {
+            SDL_SetError("Duplicate asset %s", inputs[i].name.c_str());
+            throw_error;
+        }
+    }
+    auto align = [](uint64_t offset) { return (offset + bundle::alignment - 1) & ~(bundle::alignment - 1); };
+
+    bundle::Header header{};
+    std::memcpy(header.magic, bundle::magic, 4);
+    header.version = SDL_Swap32LE(bundle::version);
+    header.count = SDL_Swap32LE(static_cast<uint32_t>(inputs.size()));
+    const uint64_t toc = sizeof(bundle::Header);
+    const uint64_t names = toc + inputs.size() * sizeof(bundle::Entry);
+    header.toc = SDL_Swap64LE(toc);
+    header.names = SDL_Swap64LE(names);
+
+    std::string table;
+    for (auto& input : inputs) {
+        if (input.name.size() > 0xFFFF) {
+            SDL_SetError("Asset name too long: %s", input.name.c_str());
+            throw_error;
+        }
+        input.entry = bundle::Entry{};
+        input.entry.name = static_cast<uint32_t>(table.size());
+        input.entry.name_length = static_cast<uint16_t>(input.name.size());
+        input.entry.size = input.data.size();
+        input.entry.hash = bundle::fnv1a(input.data.data(), input.data.size());
+        table += input.name;
+        if (lz4) {
+            auto packed = compress(input.data.data(), input.data.size());
+            if (packed.size() < input.data.size()) {
+                input.data = std::move(packed);
+                input.entry.compression = bundle::LZ4;
+            }
+        }
+        input.entry.stored = input.data.size();
+    }
+    uint64_t offset = align(names + table.size());
+    for (auto& input : inputs) {
+        input.entry.offset = offset;
+        offset = align(offset + input.entry.stored);
+    }
+
+    auto file = SDL_IOFromFile(output, "wb");
+    if (!file) throw_error;
+    bool written = SDL_WriteIO(file, &header, sizeof(header)) == sizeof(header);
+    for (auto& input : inputs) {
+        bundle::Entry entry = input.entry;
+        entry.offset = SDL_Swap64LE(entry.offset);
+        entry.size = SDL_Swap64LE(entry.size);
+        entry.stored = SDL_Swap64LE(entry.stored);
+        entry.hash = SDL_Swap64LE(entry.hash);
+        entry.name = SDL_Swap32LE(entry.name);
+        entry.name_length = SDL_Swap16LE(entry.name_length);
+        written &= SDL_WriteIO(file, &entry, sizeof(entry)) == sizeof(entry);
+    }
+    written &= SDL_WriteIO(file, table.data(), table.size()) == table.size();
+    uint64_t position = names + table.size();
+    static const char zeros[bundle::alignment] = {};
+    for (auto& input : inputs) {
+        written &= SDL_WriteIO(file, zeros, input.entry.offset - position) == input.entry.offset - position;
+        written &= SDL_WriteIO(file, input.data.data(), input.data.size()) == input.data.size();
+        position = input.entry.offset + input.entry.stored;
+    }
+    if (!SDL_CloseIO(file) || !written) throw_error;
+}
+
+inline int list(const char* path) {
+    assets::Bundle bundle(path);
+    int failed = 0;
+    for (size_t i = 0; i < bundle.size(); i++) {
+        auto& entry = bundle.entry(i);
+        const bool ok = bundle.verify(i);
+        failed += !ok;
+        cout << bundle.name(i) << "  " << entry.size << " bytes";
+        if (!bundle.stored(i)) cout << ", " << entry.stored << " lz4";
+        cout << (ok ? "" : "  CORRUPT") << endl;
+    }
+    return failed ? 1 : 0;
+}
+
+int main (int argc, char* argv[]) {
+    bool lz4 = false;
+    std::string directory;
+    const char* output = nullptr;
+    std::vector<Input> inputs;
+    try {
+        int i = 1;
+        if (argc == 3 && std::string(argv[1]) == "--list") return list(argv[2]);
+        for (; i < argc && argv[i][0] == '-'; i++) {
+            const std::string option = argv[i];
+            if (option == "--lz4") lz4 = true;
+            else if (option == "-C" && i + 1 < argc) directory = argv[++i];
+            else break;
+        }
+        if (i + 1 >= argc) {
+            cerr << "Usage: pack [--lz4] [-C directory] output.pak file..." << endl;
+            cerr << "       pack --list bundle.pak" << endl;
+            return 2;
+        }
+        output = argv[i++];
+        const assets::Source source(directory);
+        for (; i < argc; i++) {
+            Input input;
+            input.name = argv[i];
+            std::replace(input.name.begin(), input.name.end(), '\\', '/');
+            input.data = load(source.resolve(argv[i]));
+            inputs.push_back(std::move(input));
+        }
+        write(output, inputs, lz4);
+    } catch (const std::exception& error) {
+        cerr << "Error in " << error.what() << endl;
+        cerr << "   " << SDL_GetError() << endl;
+        return 1;
+    }
+    size_t stored = 0, total = 0;
+    for (auto& input : inputs) {
+        stored += input.entry.stored;
+        total += input.entry.size;
+    }
+    cout << output << ": " << inputs.size() << " files, " << total << " bytes, " << stored << " stored" << endl;
+    return 0;
+}
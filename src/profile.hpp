@@ -0,0 +1,188 @@
+// profile.hpp
+#pragma once
+
+#include "sdl.hpp"
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <memory>
+
+// Scoped timing zones. Like debug_log they compile to nothing unless PROFILE is defined:
+//     profile_zone("layout");
+//     profile_frame(milliseconds);
+#ifdef PROFILE
+    #define profile_concat_(a, b) a##b
+    #define profile_concat(a, b) profile_concat_(a, b)
+    #define profile_zone(name) profile::Zone profile_concat(profile_zone_, __LINE__)(name)
+    #define profile_frame(milliseconds) profile::frames().push(milliseconds)
+#else
+    #define profile_zone(name)
+    #define profile_frame(milliseconds)
+#endif
+
+namespace profile {
+
+    struct Event {
+        const char* name;
+        uint64_t start;
+        uint64_t end;
+    };
+
+    // Single-producer ring of the most recent events of one thread. The owning thread
+    // writes without locks; readers copy a snapshot and drop entries that may have been
+    // overwritten while they were reading. Slot fields are relaxed atomics so that such a
+    // racing copy is only stale, never undefined.
+    class Ring {
+        public:
+        static constexpr uint64_t capacity = 1 << 14;
+        const uint64_t thread;
+
+        explicit Ring(const uint64_t thread): thread(thread), events(new Slot[capacity]) {}
+        void push(const Event& event) {
+            const uint64_t head = _head.load(std::memory_order_relaxed);
+            Slot& slot = events[head & (capacity - 1)];
+            slot.name.store(event.name, std::memory_order_relaxed);
+            slot.start.store(event.start, std::memory_order_relaxed);
+            slot.end.store(event.end, std::memory_order_relaxed);
+            _head.store(head + 1, std::memory_order_release);
+        }
+        std::vector<Event> snapshot() const {
+            const uint64_t head = _head.load(std::memory_order_acquire);
+            const uint64_t first = head > capacity ? head - capacity : 0;
+            std::vector<Event> out;
+            out.reserve(head - first);
+            for (uint64_t i = first; i < head; i++) {
+                const Slot& slot = events[i & (capacity - 1)];
+                out.push_back(Event{
+                    slot.name.load(std::memory_order_relaxed),
+                    slot.start.load(std::memory_order_relaxed),
+                    slot.end.load(std::memory_order_relaxed)
+                });
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            const uint64_t after = _head.load(std::memory_order_relaxed);
+            // Slots below after - capacity were reused by the writer during the copy.
+            const uint64_t stale = after > capacity ? after - capacity : 0;
+            if (stale > first) out.erase(out.begin(), out.begin() + std::min<uint64_t>(stale - first, out.size()));
+            return out;
+        }
+        private:
+        struct Slot {
+            std::atomic<const char*> name{nullptr};
+            std::atomic<uint64_t> start{0};
+            std::atomic<uint64_t> end{0};
+        };
+        std::unique_ptr<Slot[]> events;
+        std::atomic<uint64_t> _head{0};
+    };
+
+    // Rings outlive their threads so that short-lived workers still show up in exports.
+    inline std::mutex registry_mutex;
+    inline std::vector<std::unique_ptr<Ring>> registry;
+
+    inline Ring& local() {
+        thread_local Ring* ring = [] {
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            registry.emplace_back(new Ring(SDL_GetCurrentThreadID()));
+            return registry.back().get();
+        }();
+        return *ring;
+    }
+
+    class Zone {
+        public:
+        explicit Zone(const char* name): name(name), start(SDL_GetTicksNS()) {}
+        Zone(const Zone&) = delete;
+        Zone& operator=(const Zone&) = delete;
+        ~Zone() {
+            local().push(Event{name, start, SDL_GetTicksNS()});
+        }
+        private:
+        const char* name;
+        uint64_t start;
+    };
+
+    // Recent frame times of the main thread, in milliseconds.
+    class Frames {
+        public:
+        static constexpr size_t capacity = 240;
+        void push(const float milliseconds) {
+            values[head % capacity] = milliseconds;
+            head++;
+        }
+        size_t size() const { return head < capacity ? head : capacity; }
+        // i = 0 is the oldest retained frame.
+        float operator[](const size_t i) const {
+            return values[(head - size() + i) % capacity];
+        }
+        private:
+        float values[capacity] = {};
+        size_t head = 0;
+    };
+    inline Frames& frames() {
+        static Frames instance;
+        return instance;
+    }
+
+    // Frame time graph drawn with Renderer::fillRect, labelled with a Text.
+    class Overlay {
+        public:
+        float budget_ms = 1000.0f / 60;
+
+        Overlay(SDL::TTF::TextEngine& text_engine, const SDL::TTF::Font& font)
+            : label(text_engine.createText(font, " ")) {}
+
+        void draw(SDL::Video::Renderer& renderer, const math::Rectangle<float>& area) {
+            const Frames& history = frames();
+            renderer.fillRect(math::Color{0, 0, 0, 192}, area);
+            const float scale = area.height / (budget_ms * 2);
+            const float bar = area.width / Frames::capacity;
+            float total = 0, worst = 0;
+            for (size_t i = 0; i < history.size(); i++) {
+                const float ms = history[i];
+                total += ms;
+                worst = ms > worst ? ms : worst;
+                const float height = std::min(ms * scale, area.height);
+                const auto color = ms > budget_ms ? math::Color{220, 64, 64, 255} : math::Color{64, 200, 96, 255};
+                renderer.fillRect(color, math::Rectangle<float>(
+                    area.x + i * bar, area.y + area.height - height, bar > 1 ? bar - 1 : bar, height
+                ));
+            }
+            renderer.fillRect(math::Color{255, 255, 255, 96}, math::Rectangle<float>(
+                area.x, area.y + area.height - budget_ms * scale, area.width, 1
+            ));
+            if (history.size()) {
+                char text[64];
+                SDL_snprintf(text, sizeof(text), "%.2f ms  avg %.2f  max %.2f",
+                    history[history.size() - 1], total / history.size(), worst);
+                label.setText(text);
+            }
+            label.draw(math::d2::position<float>{area.x + 4, area.y + 2});
+        }
+        void setFont(const SDL::TTF::Font& font) {
+            label.setFont(font);
+        }
+        private:
+        SDL::TTF::TextEngine::Text label;
+    };
+
+    // Writes every recorded zone of every thread as Chrome trace JSON (chrome://tracing, Perfetto).
+    inline bool exportChromeTrace(const char* path) {
+        auto file = SDL_IOFromFile(path, "w");
+        if (!file) return false;
+        bool first = true;
+        SDL_IOprintf(file, "{\"traceEvents\":[\n");
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        for (auto& ring : registry) {
+            for (auto& event : ring->snapshot()) {
+                SDL_IOprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%llu,\"ts\":%.3f,\"dur\":%.3f}",
+                    first ? "" : ",\n", event.name, static_cast<unsigned long long>(ring->thread),
+                    event.start / 1000.0, (event.end - event.start) / 1000.0);
+                first = false;
+            }
+        }
+        SDL_IOprintf(file, "\n]}\n");
+        return SDL_CloseIO(file);
+    }
+
+} // namespace profile
@@ -1,10 +1,40 @@
+#pragma once
+
 #include <SDL3/SDL.h>
 #include <SDL3_image/SDL_image.h>
 #include <SDL3_ttf/SDL_ttf.h>
 #include "math.hpp"
+#include "jobs.hpp"
+#include "memory.hpp"
 #include <string>
+#include <string_view>
+#include <cstring>
 #include <stdexcept>
 #include <memory>
+#include <vector>
+#include <unordered_map>
+#include <list>
+#include <functional>
+#include <algorithm>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+
+// The wrappers hand math types to SDL by pointer, so they must share SDL's layouts.
+static_assert(sizeof(math::Rectangle<float>) == sizeof(SDL_FRect) && offsetof(math::Rectangle<float>, x) == offsetof(SDL_FRect, x)
+    && offsetof(math::Rectangle<float>, y) == offsetof(SDL_FRect, y) && offsetof(math::Rectangle<float>, width) == offsetof(SDL_FRect, w)
+    && offsetof(math::Rectangle<float>, height) == offsetof(SDL_FRect, h), "Rectangle<float> must match SDL_FRect");
+static_assert(sizeof(math::Rectangle<int>) == sizeof(SDL_Rect) && offsetof(math::Rectangle<int>, width) == offsetof(SDL_Rect, w)
+    && offsetof(math::Rectangle<int>, height) == offsetof(SDL_Rect, h), "Rectangle<int> must match SDL_Rect");
+static_assert(sizeof(math::d2::position<float>) == sizeof(SDL_FPoint) && offsetof(math::d2::position<float>, y) == offsetof(SDL_FPoint, y),
+    "position<float> must match SDL_FPoint");
+static_assert(sizeof(math::Color) == sizeof(SDL_Color) && offsetof(math::Color, alpha) == offsetof(SDL_Color, a), "Color must match SDL_Color");
+static_assert(std::is_trivially_copyable<math::Rectangle<float>>::value && std::is_trivially_copyable<math::d2::position<float>>::value,
+    "math types are copied as plain bytes");
 
 #define throw_error throw std::runtime_error(__PRETTY_FUNCTION__)
 
@@ -41,6 +71,223 @@ class SDL {
         SDL_Quit();
     };
 
+    static constexpr char font_create_prefix[] = "SDL_ttf.font.create.";
+    static constexpr char window_create_prefix[] = "SDL.window.create.";
+    static constexpr char window_prefix[] = "SDL.window.";
+
+    // Typed access to an SDL_PropertiesID whose names all start with `Prefix`.
+    // Short names ("filename", "size") are joined to the prefix in a stack buffer, so no call
+    // allocates. Key joins the name at compile time:
+    //     static constexpr SDL::TTF::Font::Config::Key size{"size"};
+    //     config.set(size, 12.0f);
+    template<const char* Prefix>
+    class PropertySet {
+        public:
+        static constexpr size_t max_name = 96;
+
+        class Key {
+            public:
+            // Too long a name fails to compile when the Key is constexpr, and throws otherwise.
+            constexpr explicit Key(const char* property): name() {
+                if (length(Prefix) + length(property) >= max_name) {
+                    SDL_SetError("Property name too long");
+                    throw_error;
+                }
+                size_t i = 0;
+                for (const char* c = Prefix; *c; c++) name[i++] = *c;
+                for (const char* c = property; *c; c++) name[i++] = *c;
+            }
+            constexpr const char* c_str() const { return name; }
+            private:
+            char name[max_name];
+        };
+
+        // Full property name; only ever a temporary argument.
+        class Name {
+            public:
+            Name(const Key& key): name(key.c_str()) {}
+            Name(const char* property): Name(std::string_view(property)) {}
+            Name(const std::string& property): Name(std::string_view(property)) {}
+            Name(const std::string_view property): name(buffer) {
+                constexpr size_t prefix = length(Prefix);
+                if (prefix + property.size() >= max_name) {
+                    SDL_SetError("Property name too long");
+                    throw_error;
+                }
+                std::memcpy(buffer, Prefix, prefix);
+                std::memcpy(buffer + prefix, property.data(), property.size());
+                buffer[prefix + property.size()] = '\0';
+            }
+            Name(const Name&) = delete;
+            Name& operator=(const Name&) = delete;
+            const char* c_str() const { return name; }
+            private:
+            const char* name;
+            char buffer[max_name];
+        };
+
+        bool has(const Name& property) const {
+            return SDL_HasProperty(sdl, property.c_str());
+        }
+        void clear(const Name& property) {
+            if (!SDL_ClearProperty(sdl, property.c_str())) throw_error;
+        }
+        SDL_PropertyType type(const Name& property) const {
+            return SDL_GetPropertyType(sdl, property.c_str());
+        }
+        bool get(const Name& property, const bool default_value) const {
+            return SDL_GetBooleanProperty(sdl, property.c_str(), default_value);
+        }
+        float get(const Name& property, const float default_value) const {
+            return SDL_GetFloatProperty(sdl, property.c_str(), default_value);
+        }
+        long long get(const Name& property, const long long default_value) const {
+            return SDL_GetNumberProperty(sdl, property.c_str(), default_value);
+        }
+        int get(const Name& property, const int default_value) const {
+            return SDL_GetNumberProperty(sdl, property.c_str(), default_value);
+        }
+        void* get(const Name& property, void* default_value) const {
+            return SDL_GetPointerProperty(sdl, property.c_str(), default_value);
+        }
+        std::string get(const Name& property, const std::string& default_value) const {
+            return SDL_GetStringProperty(sdl, property.c_str(), default_value.c_str());
+        }
+        const char* get(const Name& property, const char* default_value) const {
+            return SDL_GetStringProperty(sdl, property.c_str(), default_value);
+        }
+        void set(const Name& property, const bool value) {
+            if (!SDL_SetBooleanProperty(sdl, property.c_str(), value)) throw_error;
+        }
+        void set(const Name& property, const float value) {
+            if (!SDL_SetFloatProperty(sdl, property.c_str(), value)) throw_error;
+        }
+        void set(const Name& property, const long long value) {
+            if (!SDL_SetNumberProperty(sdl, property.c_str(), value)) throw_error;
+        }
+        void set(const Name& property, const int value) {
+            if (!SDL_SetNumberProperty(sdl, property.c_str(), value)) throw_error;
+        }
+        void set(const Name& property, void* value) {
+            if (!SDL_SetPointerProperty(sdl, property.c_str(), value)) throw_error;
+        }
+        void set(const Name& property, const std::string& value) {
+            if (!SDL_SetStringProperty(sdl, property.c_str(), value.c_str())) throw_error;
+        }
+        void set(const Name& property, const char* value) {
+            if (!SDL_SetStringProperty(sdl, property.c_str(), value)) throw_error;
+        }
+
+        protected:
+        SDL_PropertiesID sdl = 0;
+        PropertySet() = default;
+        static constexpr size_t length(const char* str) {
+            size_t n = 0;
+            while (str[n]) n++;
+            return n;
+        }
+    };
+
+    // Bottom-left skyline rectangle packer for atlas pages.
+    // The skyline is the list of top edges of everything packed so far; a new rectangle
+    // goes where it rests lowest, ties broken towards the least wasted width.
+    class Skyline {
+        public:
+        Skyline(const int width, const int height): _width(width), _height(height) {
+            reset();
+        }
+        void reset() {
+            segments.assign(1, Segment{0, 0, _width});
+            _used = 0;
+        }
+        bool insert(const int width, const int height, SDL_Rect& out) {
+            int best = -1, best_y = _height, best_waste = 0;
+            for (size_t i = 0; i < segments.size(); i++) {
+                int y, waste;
+                if (!fits(i, width, height, y, waste)) continue;
+                if (y < best_y || (y == best_y && waste < best_waste)) {
+                    best = static_cast<int>(i);
+                    best_y = y;
+                    best_waste = waste;
+                }
+            }
+            if (best < 0) return false;
+            out = SDL_Rect{segments[best].x, best_y, width, height};
+            place(best, out);
+            _used += static_cast<size_t>(width) * height;
+            return true;
+        }
+        // Area bookkeeping for callers that recycle space themselves;
+        // the skyline itself never shrinks until reset().
+        void release(const int width, const int height) {
+            _used -= static_cast<size_t>(width) * height;
+        }
+        void occupy(const int width, const int height) {
+            _used += static_cast<size_t>(width) * height;
+        }
+        size_t used() const { return _used; }
+        float occupancy() const {
+            return _used / (static_cast<float>(_width) * _height);
+        }
+        int width() const { return _width; }
+        int height() const { return _height; }
+        private:
+        struct Segment {
+            int x;
+            int y;
+            int width;
+        };
+        int _width;
+        int _height;
+        size_t _used = 0;
+        std::vector<Segment> segments;
+        bool fits(const size_t index, const int width, const int height, int& y, int& waste) const {
+            if (segments[index].x + width > _width) return false;
+            y = 0;
+            int remaining = width;
+            size_t i = index;
+            while (remaining > 0) {
+                if (i == segments.size()) return false;
+                y = std::max(y, segments[i].y);
+                if (y + height > _height) return false;
+                remaining -= segments[i].width;
+                i++;
+            }
+            waste = 0;
+            remaining = width;
+            for (size_t j = index; remaining > 0; j++) {
+                const int span = std::min(remaining, segments[j].width);
+                waste += (y - segments[j].y) * span;
+                remaining -= span;
+            }
+            return true;
+        }
+        void place(const int index, const SDL_Rect& rect) {
+            const Segment top{rect.x, rect.y + rect.h, rect.w};
+            segments.insert(segments.begin() + index, top);
+            const int right = rect.x + rect.w;
+            size_t i = index + 1;
+            while (i < segments.size() && segments[i].x < right) {
+                const int end = segments[i].x + segments[i].width;
+                if (end <= right) {
+                    segments.erase(segments.begin() + i);
+                    continue;
+                }
+                segments[i].width = end - right;
+                segments[i].x = right;
+                break;
+            }
+            // Merge neighbours of equal height to keep the skyline short.
+            for (size_t j = 0; j + 1 < segments.size();) {
+                if (segments[j].y == segments[j + 1].y) {
+                    segments[j].width += segments[j + 1].width;
+                    segments.erase(segments.begin() + j + 1);
+                }
+                else j++;
+            }
+        }
+    };
+
     class TTF {
         private:
         bool initialized;
@@ -73,13 +320,18 @@ class SDL {
             if (initialized) TTF_Quit();
         }
 
+        class TextEngine;
+        class GlyphAtlas;
+        class FontCache;
+
         class Font {
             public:
             friend TTF;
             friend class Text;
-            class Config {
-                private:
-                SDL_PropertiesID sdl;
+            friend class TextEngine;
+            friend class GlyphAtlas;
+            friend class FontCache;
+            class Config: public PropertySet<font_create_prefix> {
                 public:
                 friend Font;
                 Config () {
@@ -111,62 +363,6 @@ class SDL {
                 ~Config () {
                     if (sdl) SDL_DestroyProperties(sdl);
                 }
-                bool has(const std::string& property) {
-                    return SDL_HasProperty(sdl, ("SDL_ttf.font.create." + property).c_str());
-                }
-                void clear (const std::string& property) {
-                    if (!SDL_ClearProperty(sdl, property.c_str())) throw_error;
-                }
-                SDL_PropertyType type(const std::string& property) {
-                    return SDL_GetPropertyType(sdl, ("SDL_ttf.font.create." + property).c_str());
-                }
-                bool get(const std::string& property, const bool default_value) {
-                    return SDL_GetBooleanProperty(sdl, ("SDL_ttf.font.create." + property).c_str(), default_value);
-                }
-                float get(const std::string& property, const float default_value) {
-                    return SDL_GetFloatProperty(sdl, ("SDL_ttf.font.create." + property).c_str(), default_value);
-                }
-                long long get(const std::string& property, const long long default_value) {
-                    return SDL_GetNumberProperty(sdl, ("SDL_ttf.font.create." + property).c_str(), default_value);
-                }
-                int get(const std::string& property, const int default_value) {
-                    return SDL_GetNumberProperty(sdl, ("SDL_ttf.font.create." + property).c_str(), default_value);
-                }
-                void* get(const std::string& property, void* default_value) {
-                    return SDL_GetPointerProperty(sdl, ("SDL_ttf.font.create." + property).c_str(), default_value);
-                }
-                std::string get(const std::string& property, const std::string& default_value) {
-                    return SDL_GetStringProperty(sdl, ("SDL_ttf.font.create." + property).c_str(), default_value.c_str());
-                }
-                const char* get(const std::string& property, const char* default_value) {
-                    return SDL_GetStringProperty(sdl, ("SDL_ttf.font.create." + property).c_str(), default_value);
-                }
-                void set(const std::string& property, const bool value) {
-                    if (!SDL_SetBooleanProperty(sdl, ("SDL_ttf.font.create." + property).c_str(), value)) throw_error;
-                }
-                void set(const std::string& property, const float value) {
-                    if (!SDL_SetFloatProperty(sdl, ("SDL_ttf.font.create." + property).c_str(), value)) throw_error;
-                }
-
-                void set(const std::string& property, const long long value) {
-                    if (!SDL_SetNumberProperty(sdl, ("SDL_ttf.font.create." + property).c_str(), value)) throw_error;
-                }
-
-                void set(const std::string& property, const int value) {
-                    if (!SDL_SetNumberProperty(sdl, ("SDL_ttf.font.create." + property).c_str(), value)) throw_error;
-                }
-
-                void set(const std::string& property, void* value) {
-                    if (!SDL_SetPointerProperty(sdl, ("SDL_ttf.font.create." + property).c_str(), value)) throw_error;
-                }
-
-                void set(const std::string& property, const std::string& value) {
-                    if (!SDL_SetStringProperty(sdl, ("SDL_ttf.font.create." + property).c_str(), value.c_str())) throw_error;
-                }
-
-                void set(const std::string& property, const char* value) {
-                    if (!SDL_SetStringProperty(sdl, ("SDL_ttf.font.create." + property).c_str(), value)) throw_error;
-                }
             };
             void destroy() {
                 if (sdl){
@@ -188,19 +384,30 @@ class SDL {
                 int dpi = 96 * scale;
                 if(!TTF_SetFontSizeDPI(sdl, point_size, dpi, dpi)) throw_error;
             }
+            int height() const {
+                return TTF_GetFontHeight(sdl);
+            }
+            int lineSkip() const {
+                return TTF_GetFontLineSkip(sdl);
+            }
             Font (Font&& other) {
                 sdl = other.sdl;
+                id = other.id;
                 other.sdl = nullptr;
             }
             Font& operator=(Font&& other) {
                 if (this != &other) {
                     sdl = other.sdl;
+                    id = other.id;
                     other.sdl = nullptr;
                 }
                 return *this;
             }
             private:
             TTF_Font* sdl;
+            // Unique for the whole run; a closed font's address may be reused, its id never is.
+            uint64_t id = next();
+            Font (TTF_Font* font): sdl(font) {}
             Font (const char* file, float point_size) {
                 sdl = TTF_OpenFont(file, point_size);
                 if (!sdl) throw_error;
@@ -213,6 +420,10 @@ class SDL {
                 sdl = TTF_OpenFontWithProperties(config.sdl);
                 if (!sdl) throw_error;
             }
+            static uint64_t next() {
+                static std::atomic<uint64_t> count{0};
+                return ++count;
+            }
         };
         Font loadFont(const char* file, float point_size) {
             return Font(file, point_size);
@@ -233,6 +444,157 @@ class SDL {
         std::unique_ptr<Font> loadFontU(Font::Config&& config) {
             return std::unique_ptr<Font>(new Font(config));
         }
+
+        // Faces opened on first use for each (file, point size, DPI). A file is read once and shared
+        // by all of its sizes through TTF_OpenFontIO; the least recently used faces are dropped from
+        // the cache once their estimated footprint exceeds the budget. A face handed out stays valid,
+        // together with the bytes it reads from, for as long as the caller holds on to it.
+        class FontCache {
+            public:
+            friend TTF;
+            // Contents of a font file; `owner` keeps `data` alive.
+            struct Bytes {
+                const void* data = nullptr;
+                size_t size = 0;
+                std::shared_ptr<const void> owner;
+            };
+            // Resolves a file name to its bytes, throwing if it can't. Defaults to SDL_LoadFile.
+            using Loader = std::function<Bytes(const std::string& file)>;
+            struct Stats {
+                size_t faces = 0;
+                size_t bytes = 0;
+                size_t hits = 0;
+                size_t misses = 0;
+                size_t evictions = 0;
+            };
+            FontCache (FontCache&& other) = default;
+            FontCache& operator=(FontCache&& other) = default;
+
+            std::shared_ptr<Font> get(const std::string& file, const float point_size, const int dpi) {
+                const Key key{file, point_size, dpi};
+                auto found = index.find(key);
+                if (found != index.end()) {
+                    _stats.hits++;
+                    faces.splice(faces.begin(), faces, found->second);
+                    return faces.front().font;
+                }
+                _stats.misses++;
+                const Bytes bytes = load(file);
+                auto stream = SDL_IOFromConstMem(bytes.data, bytes.size);
+                if (!stream) throw_error;
+                auto sdl = TTF_OpenFontIO(stream, true, point_size);
+                if (!sdl) throw_error;
+                auto face = std::shared_ptr<Face>(new Face{bytes.owner, Font(sdl)});
+                if (!TTF_SetFontSizeDPI(sdl, point_size, dpi, dpi)) throw_error;
+
+                faces.push_front(Entry{key, std::shared_ptr<Font>(face, &face->font), cost(point_size, dpi)});
+                index.emplace(key, faces.begin());
+                _stats.bytes += faces.front().cost;
+                // Never evict the face that was just asked for, even if it alone is over budget.
+                while (_stats.bytes > budget && faces.size() > 1) evict();
+                return faces.front().font;
+            }
+            // Only affects files that are not already loaded.
+            void setLoader(Loader value) {
+                loader = std::move(value);
+            }
+            void setBudget(const size_t bytes) {
+                budget = bytes;
+                while (_stats.bytes > budget && !faces.empty()) evict();
+            }
+            size_t getBudget() const {
+                return budget;
+            }
+            // Drops every cached face; fonts still held elsewhere are unaffected.
+            void clear() {
+                _stats.evictions += faces.size();
+                faces.clear();
+                index.clear();
+                _stats.bytes = 0;
+            }
+            Stats stats() const {
+                Stats out = _stats;
+                out.faces = faces.size();
+                return out;
+            }
+            private:
+            struct Key {
+                std::string file;
+                float size;
+                int dpi;
+                bool operator==(const Key& other) const {
+                    return size == other.size && dpi == other.dpi && file == other.file;
+                }
+            };
+            struct Hash {
+                size_t operator()(const Key& key) const {
+                    size_t hash = std::hash<std::string>()(key.file);
+                    hash ^= std::hash<float>()(key.size) + 0x9E3779B9u + (hash << 6) + (hash >> 2);
+                    hash ^= std::hash<int>()(key.dpi) + 0x9E3779B9u + (hash << 6) + (hash >> 2);
+                    return hash;
+                }
+            };
+            // A font together with the file bytes FreeType keeps reading from.
+            struct Face {
+                std::shared_ptr<const void> bytes;
+                Font font;
+            };
+            struct File {
+                const void* data;
+                size_t size;
+                std::weak_ptr<const void> owner;
+            };
+            struct Entry {
+                Key key;
+                std::shared_ptr<Font> font;
+                size_t cost;
+            };
+            size_t budget;
+            Loader loader;
+            Stats _stats;
+            std::list<Entry> faces;
+            std::unordered_map<Key, std::list<Entry>::iterator, Hash> index;
+            // Files stay loaded while any of their faces is alive, in or out of the cache.
+            std::unordered_map<std::string, File> files;
+
+            FontCache (const size_t budget): budget(budget) {}
+
+            Bytes load(const std::string& file) {
+                auto found = files.find(file);
+                if (found != files.end()) {
+                    if (auto owner = found->second.owner.lock()) return Bytes{found->second.data, found->second.size, owner};
+                }
+                Bytes bytes;
+                if (loader) bytes = loader(file);
+                else {
+                    void* data = SDL_LoadFile(file.c_str(), &bytes.size);
+                    if (!data) throw_error;
+                    bytes.data = data;
+                    bytes.owner = std::shared_ptr<void>(data, SDL_free);
+                }
+                files[file] = File{bytes.data, bytes.size, bytes.owner};
+                return bytes;
+            }
+            void evict() {
+                auto& entry = faces.back();
+                _stats.bytes -= entry.cost;
+                _stats.evictions++;
+                index.erase(entry.key);
+                faces.pop_back();
+            }
+            // Rough footprint of one face: FreeType's size object plus SDL_ttf's glyph cache
+            // holding the printable ASCII range as 8-bit coverage.
+            static size_t cost(const float point_size, const int dpi) {
+                const size_t pixels = static_cast<size_t>(point_size * dpi / 72.0f) + 1;
+                return (size_t(16) << 10) + 95 * pixels * pixels;
+            }
+        };
+        FontCache createFontCache(const size_t budget = size_t(16) << 20) {
+            return FontCache(budget);
+        }
+        std::unique_ptr<FontCache> createFontCacheU(const size_t budget = size_t(16) << 20) {
+            return std::unique_ptr<FontCache>(new FontCache(budget));
+        }
         class TextEngine {
             private:
             TTF_TextEngine* sdl;
@@ -289,12 +651,15 @@ class SDL {
                 bool draw(const math::d2::position<float> position) {
                     return TTF_DrawRendererText(sdl, position.x, position.y);
                 }
-                void setText(const std::string& text) {
+                void setText(const std::string_view text) {
                     if (!TTF_SetTextString(sdl, text.data(), text.length())) throw_error;
                 }
                 bool setWrapWidth(const int width) {
                     return TTF_SetTextWrapWidth(sdl, width);
                 }
+                void setFont(const Font& font) {
+                    if (!TTF_SetTextFont(sdl, font.sdl)) throw_error;
+                }
                 Text (Text&& other) {
                     sdl = other.sdl;
                     other.sdl = nullptr;
@@ -319,6 +684,426 @@ class SDL {
             std::unique_ptr<Text> createTextU(const Font& font, const std::string& text) {
                 return std::unique_ptr<Text>(new Text(sdl, font, text));
             }
+            memory::Pool<Text>::Ptr createTextU(memory::Pool<Text>& pool, const Font& font, const std::string& text) {
+                return pool.emplace([&](void* slot) { return new (slot) Text(sdl, font, text); });
+            }
+
+            // One TTF_Text per logical line, stacked vertically.
+            // Editing a line reshapes only that line; wrap width changes are applied lazily
+            // the next time a line is measured or drawn.
+            class Paragraphs {
+                public:
+                friend TextEngine;
+                void destroy() {
+                    if (sdl) {
+                        for (auto& paragraph : paragraphs) TTF_DestroyText(paragraph.sdl);
+                        paragraphs.clear();
+                        sdl = nullptr;
+                    }
+                    else {
+                        SDL_SetError("Not valid");
+                        throw_error;
+                    }
+                }
+                ~Paragraphs() {
+                    for (auto& paragraph : paragraphs) TTF_DestroyText(paragraph.sdl);
+                }
+                Paragraphs (Paragraphs&& other) {
+                    move(other);
+                }
+                Paragraphs& operator=(Paragraphs&& other) {
+                    if (this != &other) {
+                        for (auto& paragraph : paragraphs) TTF_DestroyText(paragraph.sdl);
+                        move(other);
+                    }
+                    return *this;
+                }
+                size_t size() const {
+                    return paragraphs.size();
+                }
+                void insert(size_t index, const std::string_view text) {
+                    auto paragraph = TTF_CreateText(sdl, font, text.data(), text.length());
+                    if (!paragraph) throw_error;
+                    if (!TTF_SetTextColor(paragraph, color.red, color.green, color.blue, color.alpha)) {
+                        TTF_DestroyText(paragraph);
+                        throw_error;
+                    }
+                    paragraphs.insert(paragraphs.begin() + index, Paragraph{paragraph, 0, wrap_generation - 1});
+                }
+                void erase(size_t index, size_t count = 1) {
+                    auto first = paragraphs.begin() + index;
+                    for (auto it = first; it != first + count; ++it) TTF_DestroyText(it->sdl);
+                    paragraphs.erase(first, first + count);
+                }
+                // Returns false, leaving the layout alone, when the text is already `text`.
+                bool set(size_t index, const std::string_view text) {
+                    auto& paragraph = paragraphs[index];
+                    if (paragraph.sdl->text && text == paragraph.sdl->text) return false;
+                    if (!TTF_SetTextString(paragraph.sdl, text.data(), text.length())) throw_error;
+                    paragraph.height = 0;
+                    return true;
+                }
+                void setColor(const math::Color& value) {
+                    color = value;
+                    for (auto& paragraph : paragraphs)
+                        if (!TTF_SetTextColor(paragraph.sdl, color.red, color.green, color.blue, color.alpha)) throw_error;
+                }
+                void setWrapWidth(const int width) {
+                    if (width == wrap_width) return;
+                    wrap_width = width;
+                    wrap_generation++;
+                }
+                void setFont(const Font& value) {
+                    font = value.sdl;
+                    font_id = value.id;
+                    for (auto& paragraph : paragraphs) {
+                        if (!TTF_SetTextFont(paragraph.sdl, font)) throw_error;
+                        paragraph.height = 0;
+                    }
+                }
+                // Remeasures every line lazily, e.g. after the font was resized.
+                void reflow() {
+                    wrap_generation++;
+                }
+                int height(size_t index) {
+                    auto& paragraph = paragraphs[index];
+                    settle(paragraph);
+                    return paragraph.height;
+                }
+                int height() {
+                    int total = 0;
+                    for (auto& paragraph : paragraphs) {
+                        settle(paragraph);
+                        total += paragraph.height;
+                    }
+                    return total;
+                }
+                bool draw(size_t index, const math::d2::position<float> position) {
+                    auto& paragraph = paragraphs[index];
+                    settle(paragraph);
+                    return TTF_DrawRendererText(paragraph.sdl, position.x, position.y);
+                }
+                // Queues the paragraph's glyphs into `atlas` at the positions SDL_ttf laid them out
+                // at; nothing is drawn until the atlas is flushed.
+                void draw(size_t index, const math::d2::position<float> position, GlyphAtlas& atlas) {
+                    auto& paragraph = paragraphs[index];
+                    settle(paragraph);
+                    atlas.queue(paragraph.sdl, font, font_id, color, position);
+                }
+                // Appends the boxes covering bytes [offset, offset + length) of paragraph `index`,
+                // relative to its origin; clusters next to each other on a row are merged.
+                template<typename Allocator>
+                void ranges(size_t index, int offset, int length, std::vector<math::Rectangle<float>, Allocator>& out) {
+                    auto& paragraph = paragraphs[index];
+                    settle(paragraph);
+                    int count = 0;
+                    auto substrings = TTF_GetTextSubStringsForRange(paragraph.sdl, offset, length, &count);
+                    if (!substrings) throw_error;
+                    const size_t first = out.size();
+                    for (int i = 0; i < count; i++) {
+                        const SDL_Rect& rect = substrings[i]->rect;
+                        if (out.size() > first) {
+                            auto& last = out.back();
+                            if (last.y == rect.y && last.height == rect.h && last.x + last.width == rect.x) {
+                                last.width += static_cast<float>(rect.w);
+                                continue;
+                            }
+                        }
+                        out.emplace_back(static_cast<float>(rect.x), static_cast<float>(rect.y), static_cast<float>(rect.w), static_cast<float>(rect.h));
+                    }
+                    SDL_free(substrings);
+                }
+                bool draw(math::d2::position<float> position) {
+                    bool drawn = true;
+                    for (size_t i = 0; i < paragraphs.size(); i++) {
+                        drawn &= draw(i, position);
+                        position.y += paragraphs[i].height;
+                    }
+                    return drawn;
+                }
+                private:
+                struct Paragraph {
+                    TTF_Text* sdl;
+                    int height;
+                    unsigned int wrap_generation;
+                };
+                TTF_TextEngine* sdl;
+                TTF_Font* font;
+                uint64_t font_id;
+                math::Color color;
+                int wrap_width = 0;
+                unsigned int wrap_generation = 0;
+                std::vector<Paragraph> paragraphs;
+                Paragraphs (TTF_TextEngine* text_engine, const Font& font): sdl(text_engine), font(font.sdl), font_id(font.id) {
+                    color = math::Color{255, 255, 255, 255};
+                }
+                void move(Paragraphs& other) {
+                    sdl = other.sdl;
+                    font = other.font;
+                    font_id = other.font_id;
+                    color = other.color;
+                    wrap_width = other.wrap_width;
+                    wrap_generation = other.wrap_generation;
+                    paragraphs = std::move(other.paragraphs);
+                    other.paragraphs.clear();
+                    other.sdl = nullptr;
+                }
+                void settle(Paragraph& paragraph) {
+                    if (paragraph.wrap_generation != wrap_generation) {
+                        if (!TTF_SetTextWrapWidth(paragraph.sdl, wrap_width)) throw_error;
+                        paragraph.wrap_generation = wrap_generation;
+                        paragraph.height = 0;
+                    }
+                    if (!paragraph.height) {
+                        // Lays the text out so num_lines is current.
+                        if (!TTF_UpdateText(paragraph.sdl)) throw_error;
+                        int lines = paragraph.sdl->num_lines > 1 ? paragraph.sdl->num_lines : 1;
+                        paragraph.height = lines * TTF_GetFontLineSkip(font);
+                    }
+                }
+            };
+            Paragraphs createParagraphs(const Font& font) {
+                return Paragraphs(sdl, font);
+            }
+            std::unique_ptr<Paragraphs> createParagraphsU(const Font& font) {
+                return std::unique_ptr<Paragraphs>(new Paragraphs(sdl, font));
+            }
+        };
+
+        // Rasterized glyphs for every (font, point size, DPI) skyline-packed into shared texture pages.
+        // draw() and Paragraphs::draw(index, position, atlas) only queue quads; flush() submits one
+        // SDL_RenderGeometry per page, however many strings and paragraphs were queued. Paragraphs
+        // keep the wrapping: their glyphs go where SDL_ttf's layout put each cluster. Glyphs are
+        // keyed on the font's id rather than its TTF_Font*, so a face the FontCache closed and whose
+        // address got reused can't bring back the old face's glyphs.
+        class GlyphAtlas {
+            public:
+            friend TTF;
+            friend class TextEngine::Paragraphs;
+            GlyphAtlas (SDL_Renderer* renderer): renderer(renderer) {}
+            struct Stats {
+                size_t hits = 0;
+                size_t misses = 0;
+                size_t glyphs = 0;
+                size_t pages = 0;
+                size_t draw_calls = 0;
+            };
+            void destroy() {
+                if (renderer) {
+                    clear();
+                    renderer = nullptr;
+                }
+                else {
+                    SDL_SetError("Not valid");
+                    throw_error;
+                }
+            }
+            ~GlyphAtlas() {
+                for (auto& page : pages) SDL_DestroyTexture(page.texture);
+            }
+            GlyphAtlas (GlyphAtlas&& other) {
+                move(other);
+            }
+            GlyphAtlas& operator=(GlyphAtlas&& other) {
+                if (this != &other) {
+                    for (auto& page : pages) SDL_DestroyTexture(page.texture);
+                    move(other);
+                }
+                return *this;
+            }
+            // Queues `text` at `position`; returns the pen position after the last glyph.
+            math::d2::position<float> draw(
+                const Font& font,
+                const std::string& text,
+                math::d2::position<float> position,
+                const math::Color& color
+            ) {
+                const SDL_FColor tint = convert(color);
+                Key key = face(font.sdl, font.id);
+                const float left = position.x;
+                const int skip = TTF_GetFontLineSkip(font.sdl);
+                const char* cursor = text.data();
+                size_t remaining = text.length();
+                uint32_t previous = 0;
+                while (remaining) {
+                    key.codepoint = SDL_StepUTF8(&cursor, &remaining);
+                    if (key.codepoint == '\n') {
+                        position.x = left;
+                        position.y += skip;
+                        previous = 0;
+                        continue;
+                    }
+                    int kerning = 0;
+                    if (previous && TTF_GetGlyphKerning(font.sdl, previous, key.codepoint, &kerning)) position.x += kerning;
+                    previous = key.codepoint;
+                    const Glyph& glyph = find(font.sdl, key);
+                    if (glyph.page >= 0) quad(pages[glyph.page], glyph, position, tint);
+                    position.x += glyph.advance;
+                }
+                return position;
+            }
+            bool flush() {
+                bool drawn = true;
+                _stats.draw_calls = 0;
+                for (auto& page : pages) {
+                    if (page.indices.empty()) continue;
+                    drawn &= SDL_RenderGeometry(
+                        renderer, page.texture,
+                        page.vertices.data(), static_cast<int>(page.vertices.size()),
+                        page.indices.data(), static_cast<int>(page.indices.size())
+                    );
+                    _stats.draw_calls++;
+                    page.vertices.clear();
+                    page.indices.clear();
+                }
+                return drawn;
+            }
+            // Drops every cached glyph, e.g. after a DPI change made the old sizes useless.
+            void clear() {
+                for (auto& page : pages) SDL_DestroyTexture(page.texture);
+                pages.clear();
+                glyphs.clear();
+            }
+            Stats stats() const {
+                Stats stats = _stats;
+                stats.glyphs = glyphs.size();
+                stats.pages = pages.size();
+                return stats;
+            }
+            void resetStats() {
+                _stats = Stats();
+            }
+            private:
+            struct Key {
+                uint64_t font;
+                float size;
+                int hdpi;
+                int vdpi;
+                uint32_t codepoint;
+                bool operator==(const Key& other) const {
+                    return font == other.font && size == other.size && hdpi == other.hdpi
+                        && vdpi == other.vdpi && codepoint == other.codepoint;
+                }
+            };
+            struct Hash {
+                size_t operator()(const Key& key) const {
+                    size_t hash = std::hash<uint64_t>()(key.font);
+                    hash ^= std::hash<float>()(key.size) + 0x9E3779B9u + (hash << 6) + (hash >> 2);
+                    hash ^= std::hash<int>()(key.hdpi << 16 ^ key.vdpi) + 0x9E3779B9u + (hash << 6) + (hash >> 2);
+                    hash ^= std::hash<uint32_t>()(key.codepoint) + 0x9E3779B9u + (hash << 6) + (hash >> 2);
+                    return hash;
+                }
+            };
+            struct Glyph {
+                int page;
+                SDL_Rect rect;
+                int advance;
+            };
+            struct Page {
+                SDL_Texture* texture;
+                Skyline packer{page_size, page_size};
+                std::vector<SDL_Vertex> vertices;
+                std::vector<int> indices;
+            };
+            static constexpr int page_size = 1024;
+            SDL_Renderer* renderer;
+            std::unordered_map<Key, Glyph, Hash> glyphs;
+            std::vector<Page> pages;
+            Stats _stats;
+            void move(GlyphAtlas& other) {
+                renderer = other.renderer;
+                glyphs = std::move(other.glyphs);
+                pages = std::move(other.pages);
+                _stats = other._stats;
+                other.pages.clear();
+                other.glyphs.clear();
+                other.renderer = nullptr;
+            }
+            static SDL_FColor convert(const math::Color& color) {
+                return SDL_FColor{color.red / 255.0f, color.green / 255.0f, color.blue / 255.0f, color.alpha / 255.0f};
+            }
+            // Key for `font` with the codepoint still to be filled in.
+            static Key face(TTF_Font* font, const uint64_t id) {
+                Key key{id, TTF_GetFontSize(font), 0, 0, 0};
+                TTF_GetFontDPI(font, &key.hdpi, &key.vdpi);
+                return key;
+            }
+            // Queues a laid-out TTF_Text cluster by cluster, each at the rect SDL_ttf gave it.
+            void queue(TTF_Text* text, TTF_Font* font, const uint64_t id, const math::Color& color, const math::d2::position<float> position) {
+                if (!text->text || !*text->text) return;
+                const SDL_FColor tint = convert(color);
+                Key key = face(font, id);
+                TTF_SubString cluster, next;
+                if (!TTF_GetTextSubString(text, 0, &cluster)) throw_error;
+                while (cluster.length > 0) {
+                    const char* cursor = text->text + cluster.offset;
+                    size_t remaining = static_cast<size_t>(cluster.length);
+                    math::d2::position<float> pen{position.x + cluster.rect.x, position.y + cluster.rect.y};
+                    while (remaining) {
+                        key.codepoint = SDL_StepUTF8(&cursor, &remaining);
+                        // Line breaks and tabs have no glyph; the layout already accounts for them.
+                        if (key.codepoint < ' ') continue;
+                        const Glyph& glyph = find(font, key);
+                        if (glyph.page >= 0) quad(pages[glyph.page], glyph, pen, tint);
+                        pen.x += glyph.advance;
+                    }
+                    if (cluster.flags & TTF_SUBSTRING_TEXT_END) break;
+                    if (!TTF_GetNextTextSubString(text, &cluster, &next)) throw_error;
+                    cluster = next;
+                }
+            }
+            const Glyph& find(TTF_Font* font, const Key& key) {
+                auto found = glyphs.find(key);
+                if (found != glyphs.end()) {
+                    _stats.hits++;
+                    return found->second;
+                }
+                _stats.misses++;
+                Glyph glyph{-1, SDL_Rect{0, 0, 0, 0}, 0};
+                TTF_GetGlyphMetrics(font, key.codepoint, nullptr, nullptr, nullptr, nullptr, &glyph.advance);
+                auto surface = TTF_RenderGlyph_Blended(font, key.codepoint, SDL_Color{255, 255, 255, 255});
+                if (surface) {
+                    auto converted = SDL_ConvertSurface(surface, SDL_PIXELFORMAT_ARGB8888);
+                    SDL_DestroySurface(surface);
+                    if (converted && converted->w > 0 && converted->h > 0 && pack(converted->w, converted->h, glyph)) {
+                        if (!SDL_UpdateTexture(pages[glyph.page].texture, &glyph.rect, converted->pixels, converted->pitch)) {
+                            SDL_DestroySurface(converted);
+                            throw_error;
+                        }
+                    }
+                    if (converted) SDL_DestroySurface(converted);
+                }
+                return glyphs.emplace(key, glyph).first->second;
+            }
+            bool pack(const int width, const int height, Glyph& glyph) {
+                if (width + 1 > page_size || height + 1 > page_size) return false;
+                SDL_Rect rect;
+                if (pages.empty() || !pages.back().packer.insert(width + 1, height + 1, rect)) {
+                    auto texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, page_size, page_size);
+                    if (!texture) throw_error;
+                    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+                    pages.emplace_back();
+                    pages.back().texture = texture;
+                    pages.back().packer.insert(width + 1, height + 1, rect);
+                }
+                glyph.page = static_cast<int>(pages.size() - 1);
+                glyph.rect = SDL_Rect{rect.x, rect.y, width, height};
+                return true;
+            }
+            static void quad(Page& page, const Glyph& glyph, const math::d2::position<float> position, const SDL_FColor& tint) {
+                const int base = static_cast<int>(page.vertices.size());
+                const float u0 = glyph.rect.x / static_cast<float>(page_size);
+                const float v0 = glyph.rect.y / static_cast<float>(page_size);
+                const float u1 = (glyph.rect.x + glyph.rect.w) / static_cast<float>(page_size);
+                const float v1 = (glyph.rect.y + glyph.rect.h) / static_cast<float>(page_size);
+                const float x1 = position.x + glyph.rect.w;
+                const float y1 = position.y + glyph.rect.h;
+                page.vertices.push_back(SDL_Vertex{SDL_FPoint{position.x, position.y}, tint, SDL_FPoint{u0, v0}});
+                page.vertices.push_back(SDL_Vertex{SDL_FPoint{x1, position.y}, tint, SDL_FPoint{u1, v0}});
+                page.vertices.push_back(SDL_Vertex{SDL_FPoint{x1, y1}, tint, SDL_FPoint{u1, v1}});
+                page.vertices.push_back(SDL_Vertex{SDL_FPoint{position.x, y1}, tint, SDL_FPoint{u0, v1}});
+                for (int i : {0, 1, 2, 0, 2, 3}) page.indices.push_back(base + i);
+            }
         };
     };
     TTF initTTF() { return TTF(); }
@@ -371,9 +1156,7 @@ class SDL {
             friend Video;
             friend class Renderer;
             friend class Events;
-            class Config {
-                private:
-                SDL_PropertiesID sdl;
+            class Config: public PropertySet<window_create_prefix> {
                 public:
                 friend Window;
                 Config () {
@@ -403,66 +1186,10 @@ class SDL {
                 ~Config () {
                     if (sdl) SDL_DestroyProperties(sdl);
                 }
-                bool has(const std::string& property) {
-                    return SDL_HasProperty(sdl, ("SDL.window.create." + property).c_str());
-                }
-                void clear (const std::string& property) {
-                    if (!SDL_ClearProperty(sdl, property.c_str())) throw_error;
-                }
-                SDL_PropertyType type(const std::string& property) {
-                    return SDL_GetPropertyType(sdl, ("SDL.window.create." + property).c_str());
-                }
-                bool get(const std::string& property, const bool default_value) {
-                    return SDL_GetBooleanProperty(sdl, ("SDL.window.create." + property).c_str(), default_value);
-                }
-                float get(const std::string& property, const float default_value) {
-                    return SDL_GetFloatProperty(sdl, ("SDL.window.create." + property).c_str(), default_value);
-                }
-                long long get(const std::string& property, const long long default_value) {
-                    return SDL_GetNumberProperty(sdl, ("SDL.window.create." + property).c_str(), default_value);
-                }
-                int get(const std::string& property, const int default_value) {
-                    return SDL_GetNumberProperty(sdl, ("SDL.window.create." + property).c_str(), default_value);
-                }
-                void* get(const std::string& property, void* default_value) {
-                    return SDL_GetPointerProperty(sdl, ("SDL.window.create." + property).c_str(), default_value);
-                }
-                std::string get(const std::string& property, const std::string& default_value) {
-                    return SDL_GetStringProperty(sdl, ("SDL.window.create." + property).c_str(), default_value.c_str());
-                }
-                const char* get(const std::string& property, const char* default_value) {
-                    return SDL_GetStringProperty(sdl, ("SDL.window.create." + property).c_str(), default_value);
-                }
-                void set(const std::string& property, const bool value) {
-                    if (!SDL_SetBooleanProperty(sdl, ("SDL.window.create." + property).c_str(), value)) throw_error;
-                }
-                void set(const std::string& property, const float value) {
-                    if (!SDL_SetFloatProperty(sdl, ("SDL.window.create." + property).c_str(), value)) throw_error;
-                }
-
-                void set(const std::string& property, const long long value) {
-                    if (!SDL_SetNumberProperty(sdl, ("SDL.window.create." + property).c_str(), value)) throw_error;
-                }
-
-                void set(const std::string& property, const int value) {
-                    if (!SDL_SetNumberProperty(sdl, ("SDL.window.create." + property).c_str(), value)) throw_error;
-                }
-
-                void set(const std::string& property, void* value) {
-                    if (!SDL_SetPointerProperty(sdl, ("SDL.window.create." + property).c_str(), value)) throw_error;
-                }
-
-                void set(const std::string& property, const std::string& value) {
-                    if (!SDL_SetStringProperty(sdl, ("SDL.window.create." + property).c_str(), value.c_str())) throw_error;
-                }
-
-                void set(const std::string& property, const char* value) {
-                    if (!SDL_SetStringProperty(sdl, ("SDL.window.create." + property).c_str(), value)) throw_error;
-                }
             };
-            class Properties {
+            // The window's own properties; SDL owns them and frees them with the window.
+            class Properties: public PropertySet<window_prefix> {
                 private:
-                SDL_PropertiesID sdl;
                 Properties(SDL_Window* window){
                     sdl = SDL_GetWindowProperties(window);
                     if (!sdl) throw_error;
@@ -481,51 +1208,6 @@ class SDL {
                     }
                     return *this;
                 }
-                void destroy() {
-                    if (sdl) SDL_DestroyProperties(sdl);
-                    else {
-                        SDL_SetError("not valid");
-                        throw_error;
-                    }
-                    sdl = 0;
-                }
-                ~Properties () {
-                    if (sdl) SDL_DestroyProperties(sdl);
-                }
-                bool has (const std::string& property) {
-                    return SDL_HasProperty(sdl, ("SDL.window." + property).c_str());
-                }
-                SDL_PropertyType type (const std::string& property) {
-                    return SDL_GetPropertyType(sdl, ("SDL.window." + property).c_str());
-                }
-
-                bool get(const std::string& property, const bool default_value) {
-                    return SDL_GetBooleanProperty(sdl, ("SDL.window." + property).c_str(), default_value);
-                }
-
-                float get(const std::string& property, const float default_value) {
-                    return SDL_GetFloatProperty(sdl, ("SDL.window." + property).c_str(), default_value);
-                }
-
-                long long get(const std::string& property, const long long default_value) {
-                    return SDL_GetNumberProperty(sdl, ("SDL.window." + property).c_str(), default_value);
-                }
-
-                int get(const std::string& property, const int default_value) {
-                    return SDL_GetNumberProperty(sdl, ("SDL.window." + property).c_str(), default_value);
-                }
-
-                void* get(const std::string& property, void* default_value) {
-                    return SDL_GetPointerProperty(sdl, ("SDL.window." + property).c_str(), default_value);
-                }
-
-                std::string get(const std::string& property, const std::string& default_value) {
-                    return SDL_GetStringProperty(sdl, ("SDL.window." + property).c_str(), default_value.c_str());
-                }
-
-                const char* get(const std::string& property, const char* default_value) {
-                    return SDL_GetStringProperty(sdl, ("SDL.window." + property).c_str(), default_value);
-                }
             };
             bool die;
             void destroy () {
@@ -583,6 +1265,16 @@ class SDL {
             void setMinimumSize(const math::d2::size<int>& size) {
                 if (!SDL_SetWindowMinimumSize(sdl, size.width, size.height)) throw_error;
             }
+            void setTitle(const std::string& title) {
+                if (!SDL_SetWindowTitle(sdl, title.c_str())) throw_error;
+            }
+            // Both return at once; `callback` runs later, possibly on another thread.
+            void showOpenFileDialog(SDL_DialogFileCallback callback, void* userdata, const char* location = nullptr) {
+                SDL_ShowOpenFileDialog(callback, userdata, sdl, nullptr, 0, location, false);
+            }
+            void showSaveFileDialog(SDL_DialogFileCallback callback, void* userdata, const char* location = nullptr) {
+                SDL_ShowSaveFileDialog(callback, userdata, sdl, nullptr, 0, location);
+            }
             Renderer createRenderer(const std::string& api) {
                 return Renderer(sdl, api);
             }
@@ -637,18 +1329,18 @@ class SDL {
             friend Window;
             friend TTF;
             Renderer (Renderer&& other) {
-                sdl = other.sdl;
-                other.sdl = nullptr;
+                move(other);
             }
             Renderer& operator=(Renderer&& other) {
                 if (this != &other) {
-                    sdl = other.sdl;
-                    other.sdl = nullptr;
+                    move(other);
                 }
                 return *this;
             }
             void destroy() {
                 if (sdl) {
+                    if (canvas) SDL_DestroyTexture(canvas);
+                    canvas = nullptr;
                     SDL_DestroyRenderer(sdl);
                     sdl = nullptr;
                 }
@@ -658,7 +1350,10 @@ class SDL {
                 }
             }
             ~Renderer() {
-                if (sdl) SDL_DestroyRenderer(sdl);
+                if (sdl) {
+                    if (canvas) SDL_DestroyTexture(canvas);
+                    SDL_DestroyRenderer(sdl);
+                }
             }
 
             class Texture {
@@ -668,6 +1363,18 @@ class SDL {
                     sdl = IMG_LoadTexture(renderer, file);
                     if (!sdl) throw_error;
                 }
+                Texture (SDL_Renderer* renderer, SDL_IOStream* stream) {
+                    sdl = IMG_LoadTexture_IO(renderer, stream, true);
+                    if (!sdl) throw_error;
+                }
+                Texture (SDL_Texture* texture): sdl(texture) {}
+                // 1x1 texture of a solid color, used as a stand-in.
+                Texture (SDL_Renderer* renderer, const math::Color& color) {
+                    sdl = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC, 1, 1);
+                    if (!sdl) throw_error;
+                    const uint8_t pixel[4] = {color.red, color.green, color.blue, color.alpha};
+                    if (!SDL_UpdateTexture(sdl, nullptr, pixel, 4)) throw_error;
+                }
                 public:
                 friend Renderer;
                 Texture (Texture&& other) {
@@ -704,6 +1411,561 @@ class SDL {
             std::unique_ptr<Texture> loadTextureU(const char* file) {
                 return std::unique_ptr<Texture>(new Texture(sdl, file));
             }
+            memory::Pool<Texture>::Ptr loadTextureU(memory::Pool<Texture>& pool, const char* file) {
+                return pool.emplace([&](void* slot) { return new (slot) Texture(sdl, file); });
+            }
+            // Decodes from `stream` and closes it.
+            Texture loadTexture(SDL_IOStream* stream) {
+                return Texture(sdl, stream);
+            }
+            std::unique_ptr<Texture> loadTextureU(SDL_IOStream* stream) {
+                return std::unique_ptr<Texture>(new Texture(sdl, stream));
+            }
+            memory::Pool<Texture>::Ptr loadTextureU(memory::Pool<Texture>& pool, SDL_IOStream* stream) {
+                return pool.emplace([&](void* slot) { return new (slot) Texture(sdl, stream); });
+            }
+
+            // Accumulates rects, textured quads and lines into structure-of-arrays vertex streams.
+            // submit() sorts the batches by layer, blend mode and texture and draws each with a
+            // single SDL_RenderGeometryRaw call. Within a layer draw order is only kept per batch,
+            // so overlapping primitives that must stack go on different layers.
+            class DrawList {
+                public:
+                friend Renderer;
+                DrawList (SDL_Renderer* renderer): renderer(renderer) {}
+                void reserve(const size_t quads) {
+                    positions.reserve(quads * 8);
+                    colors.reserve(quads * 4);
+                    coordinates.reserve(quads * 8);
+                }
+                // Empties the list but keeps its storage, so steady frames do not allocate. Batches
+                // nothing was drawn into since the last clear() are dropped, so textures that are no
+                // longer drawn don't pile up.
+                void clear() {
+                    positions.clear();
+                    colors.clear();
+                    coordinates.clear();
+                    batches.erase(
+                        std::remove_if(batches.begin(), batches.end(), [](const Batch& batch) { return batch.indices.empty(); }),
+                        batches.end()
+                    );
+                    for (auto& batch : batches) batch.indices.clear();
+                    layer = 0;
+                    last = 0;
+                }
+                void setLayer(const int value) {
+                    layer = value;
+                }
+                size_t vertices() const {
+                    return colors.size();
+                }
+                void rect(const math::Color& color, const math::Rectangle<float>& rectangle, const SDL_BlendMode blend = SDL_BLENDMODE_BLEND) {
+                    quad(batch(nullptr, blend), rectangle, convert(color), 0, 0, 0, 0);
+                }
+                void texture(
+                    const Texture& texture,
+                    const math::Rectangle<float>& destination,
+                    const math::Rectangle<float>* const source = nullptr,
+                    const math::Color& tint = math::Color{255, 255, 255, 255},
+                    const SDL_BlendMode blend = SDL_BLENDMODE_BLEND
+                ) {
+                    float width, height;
+                    if (!SDL_GetTextureSize(texture.sdl, &width, &height)) throw_error;
+                    float u0 = 0, v0 = 0, u1 = 1, v1 = 1;
+                    if (source) {
+                        u0 = source->x / width;
+                        v0 = source->y / height;
+                        u1 = (source->x + source->width) / width;
+                        v1 = (source->y + source->height) / height;
+                    }
+                    quad(batch(texture.sdl, blend), destination, convert(tint), u0, v0, u1, v1);
+                }
+                void line(
+                    const math::d2::position<float> from,
+                    const math::d2::position<float> to,
+                    const math::Color& color,
+                    const float thickness = 1.0f
+                ) {
+                    float dx = to.x - from.x, dy = to.y - from.y;
+                    const float length = SDL_sqrtf(dx * dx + dy * dy);
+                    if (length <= 0) return;
+                    // Offset perpendicular to the line by half the thickness on each side.
+                    const float nx = -dy / length * thickness * 0.5f, ny = dx / length * thickness * 0.5f;
+                    Batch& target = batch(nullptr, SDL_BLENDMODE_BLEND);
+                    const int base = static_cast<int>(vertices());
+                    const float points[8] = {
+                        from.x + nx, from.y + ny, to.x + nx, to.y + ny,
+                        to.x - nx, to.y - ny, from.x - nx, from.y - ny
+                    };
+                    positions.insert(positions.end(), points, points + 8);
+                    append(target, base, convert(color), 0, 0, 0, 0);
+                }
+                // Draws every batch; returns the number of draw calls, or -1 if one failed.
+                // Textures and the renderer get their own blend modes back once the batches are queued.
+                int submit() {
+                    order.clear();
+                    for (size_t i = 0; i < batches.size(); i++)
+                        if (!batches[i].indices.empty()) order.push_back(i);
+                    std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+                        const Batch& x = batches[a];
+                        const Batch& y = batches[b];
+                        if (x.layer != y.layer) return x.layer < y.layer;
+                        if (x.blend != y.blend) return x.blend < y.blend;
+                        return x.texture < y.texture;
+                    });
+                    int calls = 0;
+                    bool drawn = true;
+                    SDL_BlendMode draw_blend;
+                    if (!SDL_GetRenderDrawBlendMode(renderer, &draw_blend)) throw_error;
+                    for (size_t i : order) {
+                        const Batch& batch = batches[i];
+                        SDL_BlendMode previous = SDL_BLENDMODE_BLEND;
+                        if (batch.texture) {
+                            SDL_GetTextureBlendMode(batch.texture, &previous);
+                            SDL_SetTextureBlendMode(batch.texture, batch.blend);
+                        }
+                        else SDL_SetRenderDrawBlendMode(renderer, batch.blend);
+                        drawn &= SDL_RenderGeometryRaw(
+                            renderer, batch.texture,
+                            positions.data(), 2 * sizeof(float),
+                            colors.data(), sizeof(SDL_FColor),
+                            batch.texture ? coordinates.data() : nullptr, 2 * sizeof(float),
+                            static_cast<int>(vertices()),
+                            batch.indices.data(), static_cast<int>(batch.indices.size()), sizeof(int)
+                        );
+                        if (batch.texture) SDL_SetTextureBlendMode(batch.texture, previous);
+                        calls++;
+                    }
+                    SDL_SetRenderDrawBlendMode(renderer, draw_blend);
+                    return drawn ? calls : -1;
+                }
+                private:
+                struct Batch {
+                    SDL_Texture* texture;
+                    SDL_BlendMode blend;
+                    int layer;
+                    std::vector<int> indices;
+                };
+                SDL_Renderer* renderer;
+                std::vector<float> positions;
+                std::vector<SDL_FColor> colors;
+                std::vector<float> coordinates;
+                std::vector<Batch> batches;
+                std::vector<size_t> order;
+                int layer = 0;
+                size_t last = 0;
+                static SDL_FColor convert(const math::Color& color) {
+                    return SDL_FColor{color.red / 255.0f, color.green / 255.0f, color.blue / 255.0f, color.alpha / 255.0f};
+                }
+                Batch& batch(SDL_Texture* const texture, const SDL_BlendMode blend) {
+                    // Consecutive primitives usually share a batch, so check the last one first.
+                    if (last < batches.size()) {
+                        Batch& cached = batches[last];
+                        if (cached.texture == texture && cached.blend == blend && cached.layer == layer) return cached;
+                    }
+                    for (size_t i = 0; i < batches.size(); i++) {
+                        Batch& batch = batches[i];
+                        if (batch.texture == texture && batch.blend == blend && batch.layer == layer) {
+                            last = i;
+                            return batch;
+                        }
+                    }
+                    last = batches.size();
+                    batches.push_back(Batch{texture, blend, layer, {}});
+                    return batches.back();
+                }
+                void quad(Batch& target, const math::Rectangle<float>& r, const SDL_FColor& color, float u0, float v0, float u1, float v1) {
+                    const int base = static_cast<int>(vertices());
+                    const float points[8] = {
+                        r.x, r.y, r.x + r.width, r.y,
+                        r.x + r.width, r.y + r.height, r.x, r.y + r.height
+                    };
+                    positions.insert(positions.end(), points, points + 8);
+                    append(target, base, color, u0, v0, u1, v1);
+                }
+                void append(Batch& target, const int base, const SDL_FColor& color, float u0, float v0, float u1, float v1) {
+                    const float uv[8] = {u0, v0, u1, v0, u1, v1, u0, v1};
+                    coordinates.insert(coordinates.end(), uv, uv + 8);
+                    colors.insert(colors.end(), 4, color);
+                    const int indices[6] = {base, base + 1, base + 2, base, base + 2, base + 3};
+                    target.indices.insert(target.indices.end(), indices, indices + 6);
+                }
+            };
+            DrawList createDrawList() {
+                return DrawList(sdl);
+            }
+            std::unique_ptr<DrawList> createDrawListU() {
+                return std::unique_ptr<DrawList>(new DrawList(sdl));
+            }
+
+            // Decodes images with IMG_Load on worker threads. The render thread uploads the
+            // finished surfaces in update() within a time budget; until then get() returns a
+            // placeholder texture, so startup with many images never blocks a frame.
+            class TextureLoader {
+                public:
+                friend Renderer;
+                struct Handle {
+                    uint32_t index;
+                };
+                enum class State { Pending, Ready, Failed };
+                TextureLoader (SDL_Renderer* renderer, unsigned int threads = 0): renderer(renderer) {
+                    placeholder.reset(new Texture(renderer, math::Color{255, 0, 255, 255}));
+                    if (!threads) {
+                        const int cores = SDL_GetNumLogicalCPUCores();
+                        threads = cores > 2 ? std::min(cores - 1, 4) : 1;
+                    }
+                    try {
+                        for (unsigned int i = 0; i < threads; i++) workers.emplace_back([this] { work(); });
+                    } catch (...) {
+                        // The destructor won't run, so stop the workers that did start before unwinding.
+                        {
+                            std::lock_guard<std::mutex> lock(mutex);
+                            stopping = true;
+                        }
+                        wake.notify_all();
+                        for (auto& worker : workers) worker.join();
+                        throw;
+                    }
+                }
+                // Decodes on `scheduler` instead of threads of its own.
+                TextureLoader (SDL_Renderer* renderer, jobs::Scheduler& scheduler): renderer(renderer), scheduler(&scheduler) {
+                    placeholder.reset(new Texture(renderer, math::Color{255, 0, 255, 255}));
+                }
+                TextureLoader (const TextureLoader&) = delete;
+                TextureLoader& operator=(const TextureLoader&) = delete;
+                ~TextureLoader() {
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        stopping = true;
+                    }
+                    wake.notify_all();
+                    for (auto& worker : workers) worker.join();
+                    if (scheduler) scheduler->wait(decoding);
+                    for (auto& done : decoded) if (done.surface) SDL_DestroySurface(done.surface);
+                    for (auto& request : requests) if (request.stream) SDL_CloseIO(request.stream);
+                }
+                Handle load(const std::string& file) {
+                    return request(Request{0, file, nullptr});
+                }
+                // Decodes from `stream` on a worker, which closes it.
+                Handle load(SDL_IOStream* stream) {
+                    return request(Request{0, std::string(), stream});
+                }
+                // Uploads decoded surfaces until `budget_ns` has passed; returns how many were uploaded.
+                size_t update(const uint64_t budget_ns) {
+                    const uint64_t start = SDL_GetTicksNS();
+                    size_t uploaded = 0;
+                    while (SDL_GetTicksNS() - start < budget_ns) {
+                        Decoded done;
+                        {
+                            std::lock_guard<std::mutex> lock(mutex);
+                            if (decoded.empty()) break;
+                            done = decoded.front();
+                            decoded.pop_front();
+                        }
+                        Slot& slot = slots[done.index];
+                        if (done.surface) {
+                            auto texture = SDL_CreateTextureFromSurface(renderer, done.surface);
+                            SDL_DestroySurface(done.surface);
+                            if (texture) {
+                                slot.texture = textures.emplace([&](void* at) { return new (at) Texture(texture); });
+                                slot.state = State::Ready;
+                                uploaded++;
+                                continue;
+                            }
+                        }
+                        slot.state = State::Failed;
+                    }
+                    return uploaded;
+                }
+                State state(const Handle handle) const {
+                    return slots[handle.index].state;
+                }
+                bool ready(const Handle handle) const {
+                    return state(handle) == State::Ready;
+                }
+                // Number of images not uploaded yet.
+                size_t pending() const {
+                    size_t count = 0;
+                    for (auto& slot : slots) count += slot.state == State::Pending;
+                    return count;
+                }
+                const Texture& get(const Handle handle) const {
+                    const Slot& slot = slots[handle.index];
+                    return slot.state == State::Ready ? *slot.texture : *placeholder;
+                }
+                private:
+                struct Request {
+                    uint32_t index;
+                    std::string file;
+                    SDL_IOStream* stream;
+                };
+                struct Decoded {
+                    uint32_t index;
+                    SDL_Surface* surface;
+                };
+                struct Slot {
+                    State state = State::Pending;
+                    memory::Pool<Texture>::Ptr texture;
+                };
+                SDL_Renderer* renderer;
+                std::unique_ptr<Texture> placeholder;
+                memory::Pool<Texture> textures;
+                std::deque<Slot> slots;
+                std::mutex mutex;
+                std::condition_variable wake;
+                std::deque<Request> requests;
+                std::deque<Decoded> decoded;
+                std::vector<std::thread> workers;
+                jobs::Scheduler* scheduler = nullptr;
+                jobs::Group decoding;
+                bool stopping = false;
+                Handle request(Request request) {
+                    const Handle handle{static_cast<uint32_t>(slots.size())};
+                    slots.emplace_back();
+                    request.index = handle.index;
+                    if (scheduler) {
+                        scheduler->submit(decoding, [this, request] {
+                            {
+                                std::lock_guard<std::mutex> lock(mutex);
+                                if (stopping) {
+                                    if (request.stream) SDL_CloseIO(request.stream);
+                                    return;
+                                }
+                            }
+                            decode(request);
+                        });
+                        return handle;
+                    }
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        requests.push_back(std::move(request));
+                    }
+                    wake.notify_one();
+                    return handle;
+                }
+                void work() {
+                    for (;;) {
+                        Request request;
+                        {
+                            std::unique_lock<std::mutex> lock(mutex);
+                            wake.wait(lock, [this] { return stopping || !requests.empty(); });
+                            if (stopping) return;
+                            request = std::move(requests.front());
+                            requests.pop_front();
+                        }
+                        decode(request);
+                    }
+                }
+                void decode(const Request& request) {
+                    auto surface = request.stream ? IMG_Load_IO(request.stream, true) : IMG_Load(request.file.c_str());
+                    if (!surface) {
+                        debug_log("TextureLoader: %s", SDL_GetError());
+                    }
+                    std::lock_guard<std::mutex> lock(mutex);
+                    decoded.push_back(Decoded{request.index, surface});
+                }
+            };
+            std::unique_ptr<TextureLoader> createTextureLoaderU(unsigned int threads = 0) {
+                return std::unique_ptr<TextureLoader>(new TextureLoader(sdl, threads));
+            }
+            std::unique_ptr<TextureLoader> createTextureLoaderU(jobs::Scheduler& scheduler) {
+                return std::unique_ptr<TextureLoader>(new TextureLoader(sdl, scheduler));
+            }
+
+            // Packs many small images into a few large pages so that drawing them needs few
+            // texture switches. Erased regions are reused by later insertions of equal or smaller
+            // size, and a page whose images were all erased is repacked from scratch.
+            class TextureAtlas {
+                public:
+                friend Renderer;
+                // Erasing an image bumps its entry's generation, so old handles to it stop resolving.
+                struct Handle {
+                    uint32_t index;
+                    uint32_t generation;
+                };
+                struct Region {
+                    const Texture* texture;
+                    math::Rectangle<float> source;
+                };
+                TextureAtlas (SDL_Renderer* renderer, const int page_size = 2048): renderer(renderer), page_size(page_size) {}
+                TextureAtlas (TextureAtlas&& other) = default;
+                TextureAtlas& operator=(TextureAtlas&& other) = default;
+                Handle insert(const char* file) {
+                    return adopt(IMG_Load(file));
+                }
+                // Decodes from `stream` and closes it.
+                Handle insert(SDL_IOStream* stream) {
+                    return adopt(IMG_Load_IO(stream, true));
+                }
+                // Copies `surface` into the atlas; the caller keeps ownership of the surface.
+                Handle insert(SDL_Surface* surface) {
+                    const int width = surface->w, height = surface->h;
+                    if (width + padding > page_size || height + padding > page_size) {
+                        SDL_SetError("Image larger than atlas page");
+                        throw_error;
+                    }
+                    Entry entry;
+                    if (!reuse(width, height, entry) && !pack(width, height, entry)) {
+                        auto texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, page_size, page_size);
+                        if (!texture) throw_error;
+                        SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+                        pages.push_back(Page{Texture(texture), Skyline(page_size, page_size), 0, {}});
+                        pack(width, height, entry);
+                    }
+                    auto converted = SDL_ConvertSurface(surface, SDL_PIXELFORMAT_ARGB8888);
+                    if (!converted) throw_error;
+                    const bool updated = SDL_UpdateTexture(pages[entry.page].texture.sdl, &entry.rect, converted->pixels, converted->pitch);
+                    SDL_DestroySurface(converted);
+                    if (!updated) throw_error;
+                    pages[entry.page].live++;
+                    Handle handle;
+                    if (!free_entries.empty()) {
+                        handle.index = free_entries.back();
+                        free_entries.pop_back();
+                        entry.generation = entries[handle.index].generation;
+                        entries[handle.index] = entry;
+                    } else {
+                        handle.index = static_cast<uint32_t>(entries.size());
+                        entries.push_back(entry);
+                    }
+                    handle.generation = entry.generation;
+                    return handle;
+                }
+                bool valid(const Handle handle) const {
+                    return handle.index < entries.size() && entries[handle.index].page >= 0
+                        && entries[handle.index].generation == handle.generation;
+                }
+                // Does nothing for a handle that was already erased.
+                void erase(const Handle handle) {
+                    if (!valid(handle)) return;
+                    Entry& entry = entries[handle.index];
+                    Page& page = pages[entry.page];
+                    page.packer.release(entry.rect.w + padding, entry.rect.h + padding);
+                    if (--page.live == 0) {
+                        page.packer.reset();
+                        page.free.clear();
+                    }
+                    else release(page.free, SDL_Rect{entry.rect.x, entry.rect.y, entry.rect.w + padding, entry.rect.h + padding});
+                    entry.page = -1;
+                    // Generation 0 is never handed out, so a zeroed Handle is always stale.
+                    if (!++entry.generation) entry.generation = 1;
+                    free_entries.push_back(handle.index);
+                }
+                Region region(const Handle handle) const {
+                    if (!valid(handle)) {
+                        SDL_SetError("Stale handle");
+                        throw_error;
+                    }
+                    const Entry& entry = entries[handle.index];
+                    return Region{
+                        &pages[entry.page].texture,
+                        math::Rectangle<float>(entry.rect.x, entry.rect.y, entry.rect.w, entry.rect.h)
+                    };
+                }
+                size_t size() const {
+                    return entries.size() - free_entries.size();
+                }
+                size_t pageCount() const {
+                    return pages.size();
+                }
+                // Fraction of all page area covered by live images.
+                float occupancy() const {
+                    if (pages.empty()) return 0;
+                    size_t used = 0;
+                    for (auto& page : pages) used += page.packer.used();
+                    return used / (static_cast<float>(page_size) * page_size * pages.size());
+                }
+                private:
+                struct Page {
+                    Texture texture;
+                    Skyline packer;
+                    size_t live;
+                    std::vector<SDL_Rect> free;
+                };
+                struct Entry {
+                    int page = -1;
+                    SDL_Rect rect;
+                    uint32_t generation = 1;
+                };
+                // One pixel gap so linear filtering never samples a neighbour.
+                static constexpr int padding = 1;
+                SDL_Renderer* renderer;
+                int page_size;
+                std::deque<Page> pages;
+                std::vector<Entry> entries;
+                std::vector<uint32_t> free_entries;
+                // Inserts a freshly decoded surface and destroys it.
+                Handle adopt(SDL_Surface* surface) {
+                    if (!surface) throw_error;
+                    try {
+                        auto handle = insert(surface);
+                        SDL_DestroySurface(surface);
+                        return handle;
+                    } catch (...) {
+                        SDL_DestroySurface(surface);
+                        throw;
+                    }
+                }
+                bool reuse(const int width, const int height, Entry& entry) {
+                    const int w = width + padding, h = height + padding;
+                    for (size_t p = 0; p < pages.size(); p++) {
+                        auto& free = pages[p].free;
+                        for (size_t i = 0; i < free.size(); i++) {
+                            SDL_Rect hole = free[i];
+                            if (w > hole.w || h > hole.h) continue;
+                            free.erase(free.begin() + i);
+                            // Guillotine split of what is left of the hole.
+                            if (hole.w > w) free.push_back(SDL_Rect{hole.x + w, hole.y, hole.w - w, h});
+                            if (hole.h > h) free.push_back(SDL_Rect{hole.x, hole.y + h, hole.w, hole.h - h});
+                            pages[p].packer.occupy(w, h);
+                            entry.page = static_cast<int>(p);
+                            entry.rect = SDL_Rect{hole.x, hole.y, width, height};
+                            return true;
+                        }
+                    }
+                    return false;
+                }
+                // Returns `hole` to `free`, merging it with any hole it shares a whole edge with so
+                // erased neighbours add back up to one rectangle instead of fragmenting the page.
+                static void release(std::vector<SDL_Rect>& free, SDL_Rect hole) {
+                    for (size_t i = 0; i < free.size();) {
+                        const SDL_Rect& other = free[i];
+                        const bool row = other.y == hole.y && other.h == hole.h
+                            && (other.x + other.w == hole.x || hole.x + hole.w == other.x);
+                        const bool column = other.x == hole.x && other.w == hole.w
+                            && (other.y + other.h == hole.y || hole.y + hole.h == other.y);
+                        if (!row && !column) {
+                            i++;
+                            continue;
+                        }
+                        hole = row
+                            ? SDL_Rect{std::min(hole.x, other.x), hole.y, hole.w + other.w, hole.h}
+                            : SDL_Rect{hole.x, std::min(hole.y, other.y), hole.w, hole.h + other.h};
+                        free[i] = free.back();
+                        free.pop_back();
+                        // The grown hole may now line up with one that was checked already.
+                        i = 0;
+                    }
+                    free.push_back(hole);
+                }
+                bool pack(const int width, const int height, Entry& entry) {
+                    for (size_t p = 0; p < pages.size(); p++) {
+                        SDL_Rect rect;
+                        if (!pages[p].packer.insert(width + padding, height + padding, rect)) continue;
+                        entry.page = static_cast<int>(p);
+                        entry.rect = SDL_Rect{rect.x, rect.y, width, height};
+                        return true;
+                    }
+                    return false;
+                }
+            };
+            TextureAtlas createTextureAtlas(const int page_size = 2048) {
+                return TextureAtlas(sdl, page_size);
+            }
+            std::unique_ptr<TextureAtlas> createTextureAtlasU(const int page_size = 2048) {
+                return std::unique_ptr<TextureAtlas>(new TextureAtlas(sdl, page_size));
+            }
 
             TTF::TextEngine createTextEngine() {
                 return TTF::TextEngine(sdl);
@@ -712,10 +1974,21 @@ class SDL {
                 return std::unique_ptr<TTF::TextEngine>(new TTF::TextEngine(sdl));
             }
 
+            TTF::GlyphAtlas createGlyphAtlas() {
+                return TTF::GlyphAtlas(sdl);
+            }
+            std::unique_ptr<TTF::GlyphAtlas> createGlyphAtlasU() {
+                return std::unique_ptr<TTF::GlyphAtlas>(new TTF::GlyphAtlas(sdl));
+            }
+
             bool setBlendMode(SDL_BlendMode mode) {
                 return SDL_SetRenderDrawBlendMode(sdl, mode);
             }
 
+            bool setVSync(const int interval) {
+                return SDL_SetRenderVSync(sdl, interval);
+            }
+
             bool clear (const math::Color& color) {
                 return SDL_SetRenderDrawColor(sdl, color.red, color.green, color.blue, color.alpha)
                         &&
@@ -723,8 +1996,69 @@ class SDL {
             }
 
             bool present() {
+                frame_arena.reset();
                 return SDL_RenderPresent(sdl);
             }
+            // Executes the queued commands now instead of at the next present.
+            bool flush() {
+                return SDL_FlushRenderer(sdl);
+            }
+            // Scratch memory for the frame being built, released when it is presented.
+            memory::Arena& scratch() {
+                return frame_arena;
+            }
+
+            // Damage tracking: widgets report the areas they changed, and a frame redraws only
+            // those into a persistent canvas texture that is then composited and presented.
+            void damage(const math::Rectangle<float>& area) {
+                if (area.empty()) return;
+                dirty = math::unite(dirty, area);
+            }
+            void damageAll() {
+                damage(math::Rectangle<float>{0, 0, static_cast<float>(INT32_MAX), static_cast<float>(INT32_MAX)});
+            }
+            bool damaged() const {
+                return !dirty.empty();
+            }
+            // Whether `area` overlaps the damage of the frame being drawn.
+            bool visible(const math::Rectangle<float>& area) const {
+                return area.intersects(dirty);
+            }
+            // Returns false when nothing is damaged; the caller then skips drawing and presenting.
+            // Otherwise targets the canvas, clipped to the damage and cleared to `background`.
+            bool beginFrame(const math::Color& background) {
+                int width, height;
+                if (!SDL_GetRenderOutputSize(sdl, &width, &height)) throw_error;
+                if (!canvas || width != canvas_size.width || height != canvas_size.height) {
+                    if (canvas) SDL_DestroyTexture(canvas);
+                    canvas = SDL_CreateTexture(sdl, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, width, height);
+                    if (!canvas) throw_error;
+                    canvas_size = math::d2::size<int>{width, height};
+                    damageAll();
+                }
+                if (!damaged()) return false;
+                dirty = math::intersect(dirty, math::Rectangle<float>(0, 0, static_cast<float>(width), static_cast<float>(height)));
+                if (!damaged()) return false;
+
+                const int x = static_cast<int>(dirty.x), y = static_cast<int>(dirty.y);
+                const SDL_Rect clip{x, y, static_cast<int>(dirty.right() + 0.999f) - x, static_cast<int>(dirty.bottom() + 0.999f) - y};
+                if (!SDL_SetRenderTarget(sdl, canvas) || !SDL_SetRenderClipRect(sdl, &clip)) throw_error;
+                const SDL_FRect area{static_cast<float>(clip.x), static_cast<float>(clip.y), static_cast<float>(clip.w), static_cast<float>(clip.h)};
+                // The clear overwrites; the caller's blend mode is put back afterwards.
+                SDL_BlendMode blend;
+                if (!SDL_GetRenderDrawBlendMode(sdl, &blend)) throw_error;
+                return SDL_SetRenderDrawBlendMode(sdl, SDL_BLENDMODE_NONE)
+                    && SDL_SetRenderDrawColor(sdl, background.red, background.green, background.blue, background.alpha)
+                    && SDL_RenderFillRect(sdl, &area)
+                    && SDL_SetRenderDrawBlendMode(sdl, blend);
+            }
+            bool endFrame() {
+                dirty = math::Rectangle<float>();
+                frame_arena.reset();
+                if (!SDL_SetRenderClipRect(sdl, nullptr) || !SDL_SetRenderTarget(sdl, nullptr)) throw_error;
+                return SDL_RenderTexture(sdl, canvas, nullptr, nullptr)
+                    && SDL_RenderPresent(sdl);
+            }
 
             bool renderTexture(
                 const Texture& texture,
@@ -743,6 +2077,25 @@ class SDL {
                 return SDL_RenderTextureTiled(sdl, texture.sdl, (SDL_FRect*) source, scale, (SDL_FRect*) destination);
             }
 
+            bool renderTexture(
+                const TextureAtlas& atlas,
+                const TextureAtlas::Handle handle,
+                const math::Rectangle<float>* const destination
+            ) {
+                const auto region = atlas.region(handle);
+                return renderTexture(*region.texture, destination, &region.source);
+            }
+
+            bool renderTextureTiled(
+                const TextureAtlas& atlas,
+                const TextureAtlas::Handle handle,
+                const math::Rectangle<float>* const destination,
+                const float scale
+            ) {
+                const auto region = atlas.region(handle);
+                return renderTextureTiled(*region.texture, destination, scale, &region.source);
+            }
+
             bool fillRect(const math::Color& color, const math::Rectangle<float>& rectangle) {
                 return SDL_SetRenderDrawColor(sdl, color.red, color.green, color.blue, color.alpha)
                         &&
@@ -751,10 +2104,23 @@ class SDL {
 
             private:
             SDL_Renderer* sdl;
+            SDL_Texture* canvas = nullptr;
+            math::d2::size<int> canvas_size;
+            math::Rectangle<float> dirty;
+            memory::Arena frame_arena;
             Renderer (SDL_Window* window, const std::string& api) {
                 sdl = SDL_CreateRenderer(window, api.c_str());
                 if (!sdl) throw_error;
             }
+            void move(Renderer& other) {
+                sdl = other.sdl;
+                canvas = other.canvas;
+                canvas_size = other.canvas_size;
+                dirty = other.dirty;
+                frame_arena = std::move(other.frame_arena);
+                other.sdl = nullptr;
+                other.canvas = nullptr;
+            }
         };
 
         private:
@@ -820,10 +2186,275 @@ class SDL {
         void pushEvent(SDL_Event &event) {
             if (!SDL_PushEvent(&event)) { throw_error; };
         }
+        // Blocks for the first event, then drains everything already queued into `batch`.
+        // Back-to-back window size, display scale and mouse motion events for the same window are
+        // coalesced into the last one, so a burst costs one frame instead of many. Only neighbours
+        // merge: anything in between, like a click after a motion, keeps its place in the order.
+        // Does not pump again after waiting, so text pointers stay valid until the next pump.
+        void pump(std::vector<SDL_Event>& batch) {
+            batch.clear();
+            batch.emplace_back();
+            waitEvent(batch.back());
+            SDL_Event events[32];
+            int count;
+            while ((count = SDL_PeepEvents(events, SDL_arraysize(events), SDL_GETEVENT, SDL_EVENT_FIRST, SDL_EVENT_LAST)) > 0) {
+                for (int i = 0; i < count; i++) {
+                    batch.push_back(events[i]);
+                    coalesce(batch);
+                }
+            }
+            if (count < 0) throw_error;
+        }
+        private:
+        static bool coalescable(const uint32_t type) {
+            switch (type) {
+                case SDL_EVENT_WINDOW_RESIZED:
+                case SDL_EVENT_WINDOW_PIXEL_SIZE_CHANGED:
+                case SDL_EVENT_WINDOW_DISPLAY_SCALE_CHANGED:
+                case SDL_EVENT_MOUSE_MOTION:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+        // Folds the event just appended to `batch` into the one before it when both are the same
+        // kind for the same window.
+        static void coalesce(std::vector<SDL_Event>& batch) {
+            if (batch.size() < 2) return;
+            SDL_Event& event = batch.back();
+            SDL_Event& previous = batch[batch.size() - 2];
+            if (event.type != previous.type || !coalescable(event.type)) return;
+            if (event.window.windowID != previous.window.windowID) return;
+            if (event.type == SDL_EVENT_MOUSE_MOTION) {
+                event.motion.xrel += previous.motion.xrel;
+                event.motion.yrel += previous.motion.yrel;
+            }
+            previous = event;
+            batch.pop_back();
+        }
+        public:
     };
     Events initEvents() { return Events(); }
     std::unique_ptr<Events> initEventsU() { return std::unique_ptr<Events>(new Events()); }
 
+    // Measures frame durations with SDL_GetTicksNS and, in Fixed mode, sleeps out the
+    // rest of the period with SDL_DelayPrecise. In VSync mode present() already blocks,
+    // so the pacer only measures.
+    class FramePacer {
+        public:
+        enum class Mode { VSync, Fixed };
+        struct Stats {
+            double frame_ms = 0;
+            double work_ms = 0;
+            double average_ms = 0;
+            double jitter_ms = 0;
+            uint64_t frames = 0;
+            uint64_t missed = 0;
+        };
+        FramePacer(const Mode mode, const uint64_t period_ns): mode(mode), period(period_ns) {}
+        // Period of one refresh of `display_mode`, falling back to 60 Hz when unknown.
+        static uint64_t refreshPeriod(const SDL_DisplayMode& display_mode) {
+            if (display_mode.refresh_rate_numerator <= 0) return SDL_NS_PER_SECOND / 60;
+            return SDL_NS_PER_SECOND * display_mode.refresh_rate_denominator / display_mode.refresh_rate_numerator;
+        }
+        void setMode(const Mode value) { mode = value; }
+        Mode getMode() const { return mode; }
+        void setPeriod(const uint64_t period_ns) { period = period_ns; }
+        uint64_t getPeriod() const { return period; }
+
+        void begin() {
+            start = SDL_GetTicksNS();
+        }
+        void end() {
+            const uint64_t work = SDL_GetTicksNS() - start;
+            if (mode == Mode::Fixed && work < period) SDL_DelayPrecise(period - work);
+            const uint64_t frame = SDL_GetTicksNS() - start;
+
+            // VSync frames may legitimately run half a refresh over before being counted late.
+            const uint64_t budget = mode == Mode::Fixed ? period + SDL_NS_PER_MS / 2 : period + period / 2;
+            if (frame > budget) _stats.missed++;
+            const double frame_ms = frame / static_cast<double>(SDL_NS_PER_MS);
+            const double deviation = frame_ms - period / static_cast<double>(SDL_NS_PER_MS);
+            _stats.frame_ms = frame_ms;
+            _stats.work_ms = work / static_cast<double>(SDL_NS_PER_MS);
+            _stats.frames++;
+            // Exponential moving averages keep the stats O(1) and smooth over single spikes.
+            const double weight = _stats.frames == 1 ? 1.0 : 1.0 / 16;
+            _stats.average_ms += (frame_ms - _stats.average_ms) * weight;
+            _stats.jitter_ms += ((deviation < 0 ? -deviation : deviation) - _stats.jitter_ms) * weight;
+        }
+        const Stats& stats() const { return _stats; }
+        void resetStats() { _stats = Stats(); }
+
+        private:
+        Mode mode;
+        uint64_t period;
+        uint64_t start = 0;
+        Stats _stats;
+    };
+
+    // Owns resources of one type in a dense array and hands out 32-bit handles to them: 20 bits
+    // of slot index and 12 of generation. Releasing bumps the slot's generation, so every copy of
+    // the handle goes stale at once, and get() returns null for it instead of a dangling pointer.
+    // Released resources are only destroyed by collect(), called once the frame that may still
+    // reference them has been presented. Removal swaps the last resource into the hole, so
+    // iteration order is not insertion order; sort() reorders for batching. Freed slots are
+    // reused oldest first and only while more than min_free are waiting, so one slot has to be
+    // recycled min_free * 4095 times before a stale handle to it could match again.
+    template<typename T>
+    class Registry {
+        public:
+        class Handle {
+            public:
+            Handle() = default;
+            uint32_t index() const { return bits & index_mask; }
+            uint32_t generation() const { return bits >> index_bits; }
+            explicit operator bool() const { return bits != 0; }
+            bool operator==(const Handle& other) const { return bits == other.bits; }
+            bool operator!=(const Handle& other) const { return bits != other.bits; }
+            private:
+            friend Registry;
+            uint32_t bits = 0;
+            Handle(const uint32_t index, const uint32_t generation): bits(generation << index_bits | index) {}
+        };
+        static constexpr uint32_t index_bits = 20;
+        static constexpr uint32_t index_mask = (uint32_t(1) << index_bits) - 1;
+        static constexpr uint32_t generation_mask = (uint32_t(1) << (32 - index_bits)) - 1;
+        static constexpr size_t min_free = 1024;
+
+        Registry() = default;
+        Registry(Registry&&) = default;
+        Registry& operator=(Registry&&) = default;
+
+        Handle add(T&& resource) {
+            uint32_t index;
+            if (free.size() <= min_free && slots.size() <= index_mask) {
+                index = static_cast<uint32_t>(slots.size());
+                slots.push_back(Slot{0, 1});
+            }
+            else if (!free.empty()) {
+                index = free.front();
+                free.pop_front();
+            }
+            else {
+                SDL_SetError("Registry is full");
+                throw_error;
+            }
+            dense.push_back(std::move(resource));
+            owners.push_back(index);
+            slots[index].dense = static_cast<uint32_t>(dense.size() - 1);
+            return Handle(index, slots[index].generation);
+        }
+        bool valid(const Handle handle) const {
+            return handle && handle.index() < slots.size() && slots[handle.index()].generation == handle.generation();
+        }
+        // Null when `handle` is stale.
+        T* get(const Handle handle) {
+            return valid(handle) ? &dense[slots[handle.index()].dense] : nullptr;
+        }
+        const T* get(const Handle handle) const {
+            return valid(handle) ? &dense[slots[handle.index()].dense] : nullptr;
+        }
+        T& at(const Handle handle) {
+            if (!valid(handle)) {
+                SDL_SetError("Stale handle");
+                throw_error;
+            }
+            return dense[slots[handle.index()].dense];
+        }
+        // Invalidates `handle` now and destroys the resource at the next collect(). False when
+        // the handle was already stale.
+        bool release(const Handle handle) {
+            if (!valid(handle)) return false;
+            Slot& slot = slots[handle.index()];
+            const uint32_t position = slot.dense;
+            doomed.push_back(std::move(dense[position]));
+            if (position + 1 != dense.size()) {
+                dense[position] = std::move(dense.back());
+                owners[position] = owners.back();
+                slots[owners[position]].dense = position;
+            }
+            dense.pop_back();
+            owners.pop_back();
+            // Generation 0 is kept for null handles.
+            slot.generation = (slot.generation + 1) & generation_mask;
+            if (!slot.generation) slot.generation = 1;
+            free.push_back(handle.index());
+            return true;
+        }
+        // Destroys everything released since the last call.
+        void collect() {
+            doomed.clear();
+        }
+        size_t size() const {
+            return dense.size();
+        }
+        // The live resources, densely packed; handle(i) names the i-th.
+        T* begin() { return dense.data(); }
+        T* end() { return dense.data() + dense.size(); }
+        const T* begin() const { return dense.data(); }
+        const T* end() const { return dense.data() + dense.size(); }
+        Handle handle(const size_t position) const {
+            const uint32_t index = owners[position];
+            return Handle(index, slots[index].generation);
+        }
+        // Reorders the dense array by `less`, e.g. by texture or font, so batches come out
+        // contiguous. Handles stay valid.
+        template<typename Less>
+        void sort(Less&& less) {
+            order.resize(dense.size());
+            for (uint32_t i = 0; i < order.size(); i++) order[i] = i;
+            std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return less(dense[a], dense[b]); });
+            // Position i takes the resource at order[i]; walk each cycle of the permutation once.
+            for (uint32_t i = 0; i < order.size(); i++) {
+                if (order[i] == i) continue;
+                T held = std::move(dense[i]);
+                const uint32_t owner = owners[i];
+                uint32_t j = i;
+                while (order[j] != i) {
+                    const uint32_t k = order[j];
+                    dense[j] = std::move(dense[k]);
+                    owners[j] = owners[k];
+                    order[j] = j;
+                    j = k;
+                }
+                dense[j] = std::move(held);
+                owners[j] = owner;
+                order[j] = j;
+            }
+            for (uint32_t i = 0; i < owners.size(); i++) slots[owners[i]].dense = i;
+        }
+
+        private:
+        struct Slot {
+            uint32_t dense;
+            uint32_t generation;
+        };
+        std::vector<T> dense;
+        std::vector<uint32_t> owners;
+        std::vector<Slot> slots;
+        std::deque<uint32_t> free;
+        std::vector<T> doomed;
+        std::vector<uint32_t> order;
+    };
+
+    // Registries for the resources frames draw with; call collect() after presenting. Declared so
+    // that texts are destroyed before the fonts they use, and textures before the windows. Must
+    // itself be destroyed before the Renderer and TextEngine: SDL_DestroyRenderer frees the
+    // textures held here, so declare it after them.
+    struct Resources {
+        Registry<Video::Window> windows;
+        Registry<TTF::Font> fonts;
+        Registry<TTF::TextEngine::Text> texts;
+        Registry<Video::Renderer::Texture> textures;
+        void collect() {
+            textures.collect();
+            texts.collect();
+            fonts.collect();
+            windows.collect();
+        }
+    };
+
     private:
     bool _quit;
 };
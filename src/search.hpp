@@ -0,0 +1,268 @@
+// search.hpp
+#pragma once
+
+#include "sdl.hpp"
+#include "document.hpp"
+#include "simd.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <regex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace totpad {
+
+    // Finds every occurrence of a query in a document snapshot on a background thread and
+    // streams the matches back, so the frame never waits for a scan. Literal queries use the
+    // SIMD substring kernel; regular expressions (ECMAScript) match within single lines.
+    // Every start() bumps a generation counter that makes the scan in flight give up.
+    class Search {
+        public:
+        struct Match {
+            size_t offset;
+            size_t length;
+        };
+        // Matches kept per search; the scan stops there.
+        static constexpr size_t limit = size_t(1) << 20;
+        static constexpr size_t block = size_t(1) << 20;
+        // std::regex recurses per character matched, so longer lines are only searched up to here.
+        static constexpr size_t line_limit = size_t(64) << 10;
+        static constexpr size_t npos = static_cast<size_t>(-1);
+
+        // With a nonzero `wake`, the search thread pushes an event of that type when it has news.
+        explicit Search(const uint32_t wake = 0): wake(wake) {
+            worker = std::thread([this] { work(); });
+        }
+        Search(const Search&) = delete;
+        Search& operator=(const Search&) = delete;
+        ~Search() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                quit = true;
+                generation++;
+            }
+            ready.notify_one();
+            worker.join();
+        }
+
+        // Searches `document` for `query`, abandoning the previous search. An empty query
+        // just clears the matches.
+        void start(const Document& document, const std::string& query, const bool regex) {
+            found.clear();
+            _failed = false;
+            _busy = !query.empty();
+            std::lock_guard<std::mutex> lock(mutex);
+            generation++;
+            streamed.clear();
+            scanning = _busy;
+            invalid = false;
+            job.reset();
+            if (!query.empty()) job.reset(new Job{generation, document.snapshot(), query, regex});
+            ready.notify_one();
+        }
+        void cancel() {
+            found.clear();
+            _failed = false;
+            _busy = false;
+            std::lock_guard<std::mutex> lock(mutex);
+            generation++;
+            streamed.clear();
+            scanning = false;
+            invalid = false;
+            job.reset();
+        }
+        // Takes the matches streamed since the last call; returns whether the state changed.
+        bool update() {
+            std::lock_guard<std::mutex> lock(mutex);
+            const bool changed = !streamed.empty() || _busy != scanning || _failed != invalid;
+            found.insert(found.end(), streamed.begin(), streamed.end());
+            streamed.clear();
+            _busy = scanning;
+            _failed = invalid;
+            return changed;
+        }
+        // Matches so far, sorted by offset and disjoint.
+        const std::vector<Match>& matches() const {
+            return found;
+        }
+        bool busy() const {
+            return _busy;
+        }
+        // Whether the query is not a valid regular expression.
+        bool failed() const {
+            return _failed;
+        }
+        // Index of the first match starting after `offset`, wrapping around; npos if none.
+        size_t next(size_t offset) const {
+            if (found.empty()) return npos;
+            auto match = std::upper_bound(found.begin(), found.end(), offset,
+                [](size_t at, const Match& m) { return at < m.offset; });
+            return match == found.end() ? 0 : static_cast<size_t>(match - found.begin());
+        }
+        // Index of the last match starting before `offset`, wrapping around; npos if none.
+        size_t previous(size_t offset) const {
+            if (found.empty()) return npos;
+            auto match = std::lower_bound(found.begin(), found.end(), offset,
+                [](const Match& m, size_t at) { return m.offset < at; });
+            return match == found.begin() ? found.size() - 1 : static_cast<size_t>(match - found.begin()) - 1;
+        }
+
+        private:
+        struct Job {
+            uint64_t generation;
+            Document::Snapshot snapshot;
+            std::string query;
+            bool regex;
+        };
+        uint32_t wake;
+        std::thread worker;
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::atomic<uint64_t> generation{0};
+        bool quit = false;
+        std::unique_ptr<Job> job;
+        // Shared with the worker under `mutex`.
+        std::vector<Match> streamed;
+        bool scanning = false;
+        bool invalid = false;
+        // Owned by the caller's thread.
+        std::vector<Match> found;
+        bool _busy = false;
+        bool _failed = false;
+
+        void work() {
+            std::unique_lock<std::mutex> lock(mutex);
+            for (;;) {
+                ready.wait(lock, [this] { return quit || job; });
+                if (quit) return;
+                std::unique_ptr<Job> current = std::move(job);
+                lock.unlock();
+                if (current->regex) expression(*current);
+                else literal(*current);
+                lock.lock();
+                if (cancelled(*current)) continue;
+                scanning = false;
+                notify();
+            }
+        }
+        bool cancelled(const Job& job) const {
+            return generation != job.generation;
+        }
+        // Hands `batch` over to the caller; returns false once the search is stale or full.
+        bool flush(const Job& job, std::vector<Match>& batch, size_t& total) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (cancelled(job)) return false;
+                streamed.insert(streamed.end(), batch.begin(), batch.end());
+            }
+            total += batch.size();
+            if (!batch.empty()) notify();
+            batch.clear();
+            return total < limit;
+        }
+        // Streams non-overlapping occurrences in 1 MiB blocks. Occurrences across a block or
+        // piece boundary are found in a small window joining the last length - 1 bytes before
+        // it with the head of what follows.
+        void literal(const Job& job) {
+            const std::string& query = job.query;
+            const size_t length = query.size();
+            std::vector<Match> batch;
+            std::string tail, window;
+            size_t total = 0, position = 0, allowed = 0;
+            bool stop = false;
+            job.snapshot.read([&](const char* data, size_t size) {
+                for (size_t from = 0; from < size && !stop; from += block) {
+                    const size_t n = std::min(block, size - from);
+                    const char* chunk = data + from;
+                    if (!tail.empty()) {
+                        const size_t base = position - tail.size();
+                        window.assign(tail).append(chunk, std::min(n, length - 1));
+                        for (size_t at = 0;;) {
+                            const size_t hit = simd::find(window.data() + at, window.size() - at, query.data(), length) + at;
+                            if (hit >= window.size() || base + hit >= position) break;
+                            if (base + hit >= allowed) {
+                                batch.push_back(Match{base + hit, length});
+                                allowed = base + hit + length;
+                            }
+                            at = hit + 1;
+                        }
+                    }
+                    for (size_t at = allowed > position ? allowed - position : 0; at < n;) {
+                        const size_t hit = simd::find(chunk + at, n - at, query.data(), length) + at;
+                        if (hit >= n) break;
+                        batch.push_back(Match{position + hit, length});
+                        at = hit + length;
+                        allowed = position + at;
+                    }
+                    if (n >= length - 1) tail.assign(chunk + n - (length - 1), length - 1);
+                    else {
+                        tail.append(chunk, n);
+                        if (tail.size() > length - 1) tail.erase(0, tail.size() - (length - 1));
+                    }
+                    position += n;
+                    if (!flush(job, batch, total)) stop = true;
+                }
+            });
+        }
+        // Runs the expression over each line; lines that span pieces are joined first.
+        void expression(const Job& job) {
+            std::regex pattern;
+            try {
+                pattern.assign(job.query, std::regex::ECMAScript | std::regex::optimize);
+            }
+            catch (const std::regex_error&) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!cancelled(job)) invalid = true;
+                return;
+            }
+            std::vector<Match> batch;
+            std::string line;
+            size_t total = 0, position = 0, start = 0, lines = 0;
+            bool stop = false;
+            auto extend = [&line](const char* data, size_t size) {
+                line.append(data, std::min(size, line_limit - std::min(line.size(), line_limit)));
+            };
+            auto scan = [&](const char* first, const char* last) {
+                if (static_cast<size_t>(last - first) > line_limit) last = first + line_limit;
+                for (std::cregex_iterator it(first, last, pattern), end; it != end; ++it) {
+                    if (it->length(0) == 0) continue;
+                    batch.push_back(Match{start + static_cast<size_t>(it->position(0)), static_cast<size_t>(it->length(0))});
+                }
+                if (cancelled(job) || (++lines % 4096 == 0 && !flush(job, batch, total))) stop = true;
+            };
+            job.snapshot.read([&](const char* data, size_t size) {
+                for (size_t at = 0; at < size && !stop;) {
+                    auto newline = static_cast<const char*>(std::memchr(data + at, '\n', size - at));
+                    const size_t end = newline ? static_cast<size_t>(newline - data) : size;
+                    if (!newline) {
+                        extend(data + at, end - at);
+                        break;
+                    }
+                    if (line.empty()) scan(data + at, data + end);
+                    else {
+                        extend(data + at, end - at);
+                        scan(line.data(), line.data() + line.size());
+                        line.clear();
+                    }
+                    at = end + 1;
+                    start = position + at;
+                }
+                position += size;
+            });
+            if (!stop) {
+                scan(line.data(), line.data() + line.size());
+                if (!stop) flush(job, batch, total);
+            }
+        }
+        void notify() {
+            if (!wake) return;
+            SDL_Event event{};
+            event.type = wake;
+            SDL_PushEvent(&event);
+        }
+    };
+
+} // namespace totpad
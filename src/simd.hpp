@@ -0,0 +1,336 @@
+// simd.hpp
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Byte scanning kernels for text: newline counting and indexing, substring search, codepoint
+// counting, UTF-8 validation and codepoint boundaries. x86 gets SSE2 everywhere and AVX2 when the CPU has
+// it, chosen at runtime; other targets use the scalar versions.
+#if defined(__x86_64__) || defined(_M_X64) || (defined(__i386__) && defined(__SSE2__))
+    #include <immintrin.h>
+    #define SIMD_SSE2 1
+    #if defined(__GNUC__) || defined(__clang__)
+        #define SIMD_AVX2 1
+        #define simd_avx2 __attribute__((target("avx2")))
+    #endif
+#endif
+
+namespace simd {
+
+    namespace detail {
+        inline unsigned int lowest(uint32_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+            return static_cast<unsigned int>(__builtin_ctz(mask));
+#else
+            unsigned int bit = 0;
+            while (!(mask & 1)) { mask >>= 1; bit++; }
+            return bit;
+#endif
+        }
+        inline bool avx2() {
+#ifdef SIMD_AVX2
+            static const bool supported = [] {
+                __builtin_cpu_init();
+                return __builtin_cpu_supports("avx2") != 0;
+            }();
+            return supported;
+#else
+            return false;
+#endif
+        }
+
+        // Byte lanes compare equal, then accumulate the -1s per lane for up to 255 blocks
+        // before folding them with psadbw, so the inner loop is one load, compare and subtract.
+#ifdef SIMD_SSE2
+        inline size_t count_sse2(const char* data, size_t size, char byte, size_t& done) {
+            const __m128i needle = _mm_set1_epi8(byte);
+            size_t total = 0, i = 0;
+            while (i + 16 <= size) {
+                __m128i lanes = _mm_setzero_si128();
+                const size_t end = i + 255 * 16 < size ? i + 255 * 16 : size;
+                for (; i + 16 <= end; i += 16) {
+                    const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+                    lanes = _mm_sub_epi8(lanes, _mm_cmpeq_epi8(block, needle));
+                }
+                const __m128i sums = _mm_sad_epu8(lanes, _mm_setzero_si128());
+                total += static_cast<size_t>(_mm_cvtsi128_si32(sums)) + static_cast<size_t>(_mm_extract_epi16(sums, 4));
+            }
+            done = i;
+            return total;
+        }
+        inline void index_sse2(const char* data, size_t size, size_t base, char byte, std::vector<size_t>& out, size_t& done) {
+            const __m128i needle = _mm_set1_epi8(byte);
+            size_t i = 0;
+            for (; i + 16 <= size; i += 16) {
+                const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+                uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle)));
+                for (; mask; mask &= mask - 1) out.push_back(base + i + lowest(mask));
+            }
+            done = i;
+        }
+        // Candidates are positions where both the first and the last byte of the needle match;
+        // only those are compared in full.
+        inline size_t find_sse2(const char* data, size_t size, const char* needle, size_t length, size_t& done) {
+            const __m128i first = _mm_set1_epi8(needle[0]);
+            const __m128i last = _mm_set1_epi8(needle[length - 1]);
+            size_t i = 0;
+            for (; i + length - 1 + 16 <= size; i += 16) {
+                const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+                const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + length - 1));
+                uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last))));
+                for (; mask; mask &= mask - 1) {
+                    const size_t at = i + lowest(mask);
+                    if (std::memcmp(data + at + 1, needle + 1, length - 2) == 0) return at;
+                }
+            }
+            done = i;
+            return size;
+        }
+        inline size_t ascii_sse2(const char* data, size_t size) {
+            size_t i = 0;
+            for (; i + 16 <= size; i += 16) {
+                const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+                if (_mm_movemask_epi8(block)) break;
+            }
+            return i;
+        }
+        // Non-continuation bytes are those above 0xBF as signed, i.e. > -65.
+        inline size_t codepoints_sse2(const char* data, size_t size, size_t& done) {
+            const __m128i limit = _mm_set1_epi8(-65);
+            size_t total = 0, i = 0;
+            while (i + 16 <= size) {
+                __m128i lanes = _mm_setzero_si128();
+                const size_t end = i + 255 * 16 < size ? i + 255 * 16 : size;
+                for (; i + 16 <= end; i += 16) {
+                    const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+                    lanes = _mm_sub_epi8(lanes, _mm_cmpgt_epi8(block, limit));
+                }
+                const __m128i sums = _mm_sad_epu8(lanes, _mm_setzero_si128());
+                total += static_cast<size_t>(_mm_cvtsi128_si32(sums)) + static_cast<size_t>(_mm_extract_epi16(sums, 4));
+            }
+            done = i;
+            return total;
+        }
+#endif
+#ifdef SIMD_AVX2
+        simd_avx2 inline size_t fold_avx2(const __m256i lanes) {
+            const __m256i sums = _mm256_sad_epu8(lanes, _mm256_setzero_si256());
+            const __m128i pair = _mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+            return static_cast<size_t>(_mm_cvtsi128_si32(pair)) + static_cast<size_t>(_mm_extract_epi16(pair, 4));
+        }
+        simd_avx2 inline size_t count_avx2(const char* data, size_t size, char byte, size_t& done) {
+            const __m256i needle = _mm256_set1_epi8(byte);
+            size_t total = 0, i = 0;
+            while (i + 32 <= size) {
+                __m256i lanes = _mm256_setzero_si256();
+                const size_t end = i + 255 * 32 < size ? i + 255 * 32 : size;
+                for (; i + 32 <= end; i += 32) {
+                    const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+                    lanes = _mm256_sub_epi8(lanes, _mm256_cmpeq_epi8(block, needle));
+                }
+                total += fold_avx2(lanes);
+            }
+            done = i;
+            return total;
+        }
+        simd_avx2 inline void index_avx2(const char* data, size_t size, size_t base, char byte, std::vector<size_t>& out, size_t& done) {
+            const __m256i needle = _mm256_set1_epi8(byte);
+            size_t i = 0;
+            for (; i + 32 <= size; i += 32) {
+                const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+                uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle)));
+                for (; mask; mask &= mask - 1) out.push_back(base + i + lowest(mask));
+            }
+            done = i;
+        }
+        simd_avx2 inline size_t find_avx2(const char* data, size_t size, const char* needle, size_t length, size_t& done) {
+            const __m256i first = _mm256_set1_epi8(needle[0]);
+            const __m256i last = _mm256_set1_epi8(needle[length - 1]);
+            size_t i = 0;
+            for (; i + length - 1 + 32 <= size; i += 32) {
+                const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+                const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + length - 1));
+                uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last))));
+                for (; mask; mask &= mask - 1) {
+                    const size_t at = i + lowest(mask);
+                    if (std::memcmp(data + at + 1, needle + 1, length - 2) == 0) return at;
+                }
+            }
+            done = i;
+            return size;
+        }
+        simd_avx2 inline size_t ascii_avx2(const char* data, size_t size) {
+            size_t i = 0;
+            for (; i + 32 <= size; i += 32) {
+                const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+                if (_mm256_movemask_epi8(block)) break;
+            }
+            return i;
+        }
+        simd_avx2 inline size_t codepoints_avx2(const char* data, size_t size, size_t& done) {
+            const __m256i limit = _mm256_set1_epi8(-65);
+            size_t total = 0, i = 0;
+            while (i + 32 <= size) {
+                __m256i lanes = _mm256_setzero_si256();
+                const size_t end = i + 255 * 32 < size ? i + 255 * 32 : size;
+                for (; i + 32 <= end; i += 32) {
+                    const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+                    lanes = _mm256_sub_epi8(lanes, _mm256_cmpgt_epi8(block, limit));
+                }
+                total += fold_avx2(lanes);
+            }
+            done = i;
+            return total;
+        }
+#endif
+    }
+
+    // Number of `byte`s in [data, data + size).
+    inline size_t count(const char* data, size_t size, char byte = '\n') {
+        size_t total = 0, i = 0;
+#if defined(SIMD_AVX2)
+        if (detail::avx2()) total = detail::count_avx2(data, size, byte, i);
+        else total = detail::count_sse2(data, size, byte, i);
+#elif defined(SIMD_SSE2)
+        total = detail::count_sse2(data, size, byte, i);
+#endif
+        for (; i < size; i++) total += data[i] == byte;
+        return total;
+    }
+
+    // Appends `base` + the offset of every `byte` in [data, data + size) to `out`.
+    inline void index(const char* data, size_t size, size_t base, std::vector<size_t>& out, char byte = '\n') {
+        size_t i = 0;
+#if defined(SIMD_AVX2)
+        if (detail::avx2()) detail::index_avx2(data, size, base, byte, out, i);
+        else detail::index_sse2(data, size, base, byte, out, i);
+#elif defined(SIMD_SSE2)
+        detail::index_sse2(data, size, base, byte, out, i);
+#else
+        // memchr is vectorized by the C library.
+        while (i < size) {
+            auto found = static_cast<const char*>(std::memchr(data + i, byte, size - i));
+            if (!found) return;
+            i = static_cast<size_t>(found - data);
+            out.push_back(base + i++);
+        }
+#endif
+        for (; i < size; i++)
+            if (data[i] == byte) out.push_back(base + i);
+    }
+
+    // Offset of the first occurrence of [needle, needle + length) in [data, data + size), or size.
+    inline size_t find(const char* data, size_t size, const char* needle, size_t length) {
+        if (length == 0) return 0;
+        if (length > size) return size;
+        if (length == 1) {
+            auto found = static_cast<const char*>(std::memchr(data, needle[0], size));
+            return found ? static_cast<size_t>(found - data) : size;
+        }
+        size_t i = 0;
+#if defined(SIMD_AVX2)
+        const size_t found = detail::avx2()
+            ? detail::find_avx2(data, size, needle, length, i)
+            : detail::find_sse2(data, size, needle, length, i);
+        if (found != size) return found;
+#elif defined(SIMD_SSE2)
+        const size_t found = detail::find_sse2(data, size, needle, length, i);
+        if (found != size) return found;
+#endif
+        while (i + length <= size) {
+            auto candidate = static_cast<const char*>(std::memchr(data + i, needle[0], size - length + 1 - i));
+            if (!candidate) return size;
+            i = static_cast<size_t>(candidate - data);
+            if (std::memcmp(data + i + 1, needle + 1, length - 1) == 0) return i;
+            i++;
+        }
+        return size;
+    }
+
+    // Length of the ASCII prefix of [data, data + size).
+    inline size_t ascii(const char* data, size_t size) {
+        size_t i = 0;
+#if defined(SIMD_AVX2)
+        i = detail::avx2() ? detail::ascii_avx2(data, size) : detail::ascii_sse2(data, size);
+#elif defined(SIMD_SSE2)
+        i = detail::ascii_sse2(data, size);
+#endif
+        while (i < size && !(static_cast<unsigned char>(data[i]) & 0x80)) i++;
+        return i;
+    }
+
+    // Number of codepoint starts (bytes that are not 10xxxxxx) in [data, data + size).
+    inline size_t codepoints(const char* data, size_t size) {
+        size_t total = 0, i = 0;
+#if defined(SIMD_AVX2)
+        if (detail::avx2()) total = detail::codepoints_avx2(data, size, i);
+        else total = detail::codepoints_sse2(data, size, i);
+#elif defined(SIMD_SSE2)
+        total = detail::codepoints_sse2(data, size, i);
+#endif
+        for (; i < size; i++) total += (static_cast<unsigned char>(data[i]) & 0xC0) != 0x80;
+        return total;
+    }
+
+    // Length of the well-formed UTF-8 sequence at `data`, or 0 when there is none
+    // (overlongs, surrogates and values past U+10FFFF are rejected).
+    inline size_t sequence(const char* data, size_t available) {
+        if (!available) return 0;
+        auto byte = [data](size_t i) { return static_cast<unsigned char>(data[i]); };
+        const unsigned char lead = byte(0);
+        if (lead < 0x80) return 1;
+        size_t length;
+        unsigned char low = 0x80, high = 0xBF;
+        if (lead >= 0xC2 && lead <= 0xDF) length = 2;
+        else if (lead >= 0xE0 && lead <= 0xEF) {
+            length = 3;
+            if (lead == 0xE0) low = 0xA0;
+            if (lead == 0xED) high = 0x9F;
+        }
+        else if (lead >= 0xF0 && lead <= 0xF4) {
+            length = 4;
+            if (lead == 0xF0) low = 0x90;
+            if (lead == 0xF4) high = 0x8F;
+        }
+        else return 0;
+        if (available < length) return 0;
+        if (byte(1) < low || byte(1) > high) return 0;
+        for (size_t i = 2; i < length; i++)
+            if ((byte(i) & 0xC0) != 0x80) return 0;
+        return length;
+    }
+
+    // Whether [data, data + size) is well-formed UTF-8. ASCII runs are skipped a vector at a time.
+    inline bool validate(const char* data, size_t size) {
+        size_t i = 0;
+        while (i < size) {
+            i += ascii(data + i, size - i);
+            if (i == size) return true;
+            const size_t length = sequence(data + i, size - i);
+            if (!length) return false;
+            i += length;
+        }
+        return true;
+    }
+
+    // Codepoint boundaries the way a decoder sees them: a well-formed sequence is one step and
+    // every byte of a malformed one is a step of its own.
+    inline size_t next(const char* data, size_t size, size_t offset) {
+        if (offset >= size) return size;
+        const size_t length = sequence(data + offset, size - offset);
+        return offset + (length ? length : 1);
+    }
+    inline size_t previous(const char* data, size_t offset) {
+        if (offset == 0) return 0;
+        for (size_t back = 1; back <= 4 && back <= offset; back++) {
+            if ((static_cast<unsigned char>(data[offset - back]) & 0xC0) == 0x80) continue;
+            if (sequence(data + offset - back, back) == back) return offset - back;
+            break;
+        }
+        return offset - 1;
+    }
+
+} // namespace simd
@@ -0,0 +1,41 @@
+// triple.hpp
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace totpad {
+
+    // Hands the latest value from one producer thread to one consumer thread without locks or
+    // waiting. The producer fills back() and publish()es it; the consumer's update() takes the
+    // newest published value as front(), skipping any it missed. Slots are reused, so the
+    // producer has to rewrite every field of back() before publishing it.
+    template<typename T>
+    class TripleBuffer {
+        public:
+        T& back() {
+            return slots[back_slot];
+        }
+        void publish() {
+            back_slot = middle.exchange(static_cast<uint8_t>(back_slot | fresh), std::memory_order_acq_rel) & slot;
+        }
+        // Whether a newer value was taken.
+        bool update() {
+            if (!(middle.load(std::memory_order_relaxed) & fresh)) return false;
+            front_slot = middle.exchange(front_slot, std::memory_order_acq_rel) & slot;
+            return true;
+        }
+        const T& front() const {
+            return slots[front_slot];
+        }
+        private:
+        static constexpr uint8_t slot = 3;
+        static constexpr uint8_t fresh = 4;
+        T slots[3];
+        // Each side's index on its own cache line.
+        alignas(64) uint8_t back_slot = 0;
+        alignas(64) std::atomic<uint8_t> middle{1};
+        alignas(64) uint8_t front_slot = 2;
+    };
+
+} // namespace totpad
@@ -0,0 +1,289 @@
+// view.hpp
+#pragma once
+
+#include "sdl.hpp"
+#include "document.hpp"
+
+namespace totpad {
+
+    // Scrollable view over a Document that only lays out the lines intersecting the
+    // viewport plus a small overscan margin. Scroll position is anchored to a document
+    // line (`top`) and a pixel offset into it, so nothing above or below the window
+    // ever has to be measured. `Source` is anything with Document's line queries:
+    // lines(), size(), line(index, out), lineStart(), lineEnd() and lineOf().
+    template<typename Source>
+    class BasicTextView {
+        public:
+        char cursor = '_';
+        size_t overscan = 2;
+
+        BasicTextView(SDL::TTF::TextEngine& text_engine, SDL::TTF::Font& font, const Source& source)
+            : source(&source), font(&font), paragraphs(text_engine.createParagraphs(font)) {}
+
+        void resize(const math::d2::size<int>& size) {
+            viewport = size;
+            paragraphs.setWrapWidth(size.width);
+            invalidate();
+        }
+        void reflow() {
+            paragraphs.reflow();
+            invalidate();
+        }
+        // The document was replaced; starts over at its top.
+        void reset() {
+            paragraphs.erase(0, paragraphs.size());
+            first = _top = _caret = 0;
+            offset = 0;
+            invalidate();
+        }
+        // Switches to another source with the same lines, e.g. a newer frame; sync() picks
+        // up any text that differs.
+        void setSource(const Source& value) {
+            source = &value;
+        }
+        // Rereads every laid-out line, redrawing those whose text changed.
+        void sync() {
+            for (size_t i = 0; i < paragraphs.size(); i++) refresh(first + i);
+        }
+        void setFont(SDL::TTF::Font& value) {
+            font = &value;
+            paragraphs.setFont(value);
+            invalidate();
+        }
+        void scroll(const float pixels) {
+            if (pixels == 0) return;
+            offset += pixels;
+            settle();
+            invalidate();
+        }
+        void page(const int pages) {
+            scroll(static_cast<float>(pages * viewport.height));
+        }
+
+        size_t caret() const { return _caret; }
+        size_t top() const { return _top; }
+
+        // Lays out the window and returns the area, relative to the viewport at `position`,
+        // that changed since the last call. Empty when nothing did.
+        math::Rectangle<float> damage(const math::d2::position<float> position) {
+            const size_t top = _top;
+            const float scrolled = offset;
+            layout();
+            if (_top != top || offset != scrolled) invalidate();
+            math::Rectangle<float> area;
+            if (dirty_first > dirty_last) return area;
+            float y = -offset, from = -1, to = -1;
+            for (size_t i = _top - first; i < paragraphs.size() && y < viewport.height; i++) {
+                const size_t line = first + i;
+                if (line >= dirty_first && from < 0) from = y;
+                y += paragraphs.height(i);
+                if (line <= dirty_last) to = y;
+            }
+            if (dirty_last == npos) to = static_cast<float>(viewport.height);
+            dirty_first = npos;
+            dirty_last = 0;
+            if (from < 0 || to <= from) return area;
+            from = std::max(from, 0.0f);
+            to = std::min(to, static_cast<float>(viewport.height));
+            return math::Rectangle<float>{position.x, position.y + from, static_cast<float>(viewport.width), to - from};
+        }
+
+        // The document replaced `old_lines` lines starting at `line` with `new_lines` lines.
+        void edited(size_t line, size_t old_lines, size_t new_lines, size_t caret) {
+            size_t previous = lineOf(_caret);
+            if (previous >= line + old_lines) previous = previous + new_lines - old_lines;
+            _caret = caret;
+            const size_t end = first + paragraphs.size();
+            if (old_lines != new_lines) mark(line, npos);
+            if (line + old_lines <= first) {
+                first = first + new_lines - old_lines;
+                _top = _top + new_lines - old_lines;
+            }
+            else if (line < first) {
+                // Edit straddles the start of the window; relayout from the edit.
+                paragraphs.erase(0, paragraphs.size());
+                first = line;
+                _top = line;
+                offset = 0;
+            }
+            else if (line < end) {
+                const size_t local = line - first;
+                if (line + old_lines <= end && new_lines <= paragraphs.size() + old_lines) {
+                    size_t i = 0;
+                    for (; i < old_lines && i < new_lines; i++) refresh(line + i);
+                    if (old_lines > new_lines) paragraphs.erase(local + i, old_lines - new_lines);
+                    for (; i < new_lines; i++) paragraphs.insert(local + i, text(line + i));
+                }
+                // Large pastes: drop the tail of the window, layout() refills only what is visible.
+                else {
+                    paragraphs.erase(local, paragraphs.size() - local);
+                    mark(line, npos);
+                }
+                if (_top > line && _top < line + old_lines) { _top = line; offset = 0; }
+            }
+            if (previous < line || previous >= line + new_lines) refresh(previous);
+            refresh(lineOf(_caret));
+            reveal();
+        }
+        void moveCaret(size_t caret) {
+            const size_t previous = lineOf(_caret);
+            _caret = caret;
+            refresh(previous);
+            refresh(lineOf(_caret));
+            reveal();
+        }
+
+        bool draw(const math::d2::position<float> position) {
+            layout();
+            bool drawn = true;
+            float y = -offset;
+            for (size_t i = _top - first; i < paragraphs.size() && y < viewport.height; i++) {
+                const float height = static_cast<float>(paragraphs.height(i));
+                if (y + height > 0) drawn &= paragraphs.draw(i, math::d2::position<float>{position.x, position.y + y});
+                y += height;
+            }
+            return drawn;
+        }
+        // Queues the visible lines into `atlas` instead, so the whole window costs one draw call
+        // per atlas page once the atlas is flushed.
+        void draw(const math::d2::position<float> position, SDL::TTF::GlyphAtlas& atlas) {
+            layout();
+            float y = -offset;
+            for (size_t i = _top - first; i < paragraphs.size() && y < viewport.height; i++) {
+                const float height = static_cast<float>(paragraphs.height(i));
+                if (y + height > 0) paragraphs.draw(i, math::d2::position<float>{position.x, position.y + y}, atlas);
+                y += height;
+            }
+        }
+        // Appends the boxes, relative to the viewport at `position`, covering the visible parts
+        // of `ranges`: elements with `offset` and `length` byte members, sorted and disjoint.
+        template<typename Range, typename Allocator>
+        void highlights(const math::d2::position<float> position, const std::vector<Range>& ranges, std::vector<math::Rectangle<float>, Allocator>& out) {
+            layout();
+            float y = -offset;
+            for (size_t i = _top - first; i < paragraphs.size() && y < viewport.height; i++) {
+                const size_t line = first + i;
+                const size_t start = source->lineStart(line), end = source->lineEnd(line);
+                // The caret glyph sits inside the paragraph text and shifts the bytes after it.
+                const size_t caret = _caret >= start && _caret <= end ? _caret - start : npos;
+                const size_t from = out.size();
+                auto range = std::lower_bound(ranges.begin(), ranges.end(), start,
+                    [](const Range& r, size_t at) { return r.offset + r.length <= at; });
+                for (; range != ranges.end() && range->offset < end; ++range) {
+                    size_t a = std::max(range->offset, start) - start;
+                    size_t b = std::min(range->offset + range->length, end) - start;
+                    if (b <= a) continue;
+                    if (caret != npos && a >= caret) a++;
+                    if (caret != npos && b > caret) b++;
+                    paragraphs.ranges(i, static_cast<int>(a), static_cast<int>(b - a), out);
+                }
+                for (size_t k = from; k < out.size(); k++) {
+                    auto& box = out[k];
+                    box = box.translated(math::d2::position<float>{position.x, y});
+                    // Clip to the viewport so partly scrolled lines don't spill over.
+                    box = math::intersect(box, math::Rectangle<float>{box.x, 0, box.width, static_cast<float>(viewport.height)});
+                    box.y += position.y;
+                }
+                y += paragraphs.height(i);
+            }
+        }
+
+        private:
+        const Source* source;
+        SDL::TTF::Font* font;
+        SDL::TTF::TextEngine::Paragraphs paragraphs;
+        math::d2::size<int> viewport;
+        size_t first = 0;
+        size_t _top = 0;
+        size_t _caret = 0;
+        float offset = 0;
+        // Dirty document lines; dirty_last == npos extends the damage to the bottom of the view.
+        static constexpr size_t npos = static_cast<size_t>(-1);
+        size_t dirty_first = npos;
+        size_t dirty_last = 0;
+        // Reused by text(), so laying out a line doesn't allocate once it has grown.
+        std::string composed;
+
+        void mark(const size_t from, const size_t to) {
+            dirty_first = std::min(dirty_first, from);
+            dirty_last = std::max(dirty_last, to);
+        }
+        void invalidate() {
+            mark(0, npos);
+        }
+
+        size_t lineOf(size_t offset) const {
+            return source->lineOf(std::min(offset, source->size()));
+        }
+        // Valid until the next call.
+        std::string_view text(size_t line) {
+            source->line(line, composed);
+            const size_t start = source->lineStart(line);
+            if (_caret >= start && _caret <= start + composed.size()) composed.insert(_caret - start, 1, cursor);
+            return composed;
+        }
+        void refresh(size_t line) {
+            if (line < first || line >= first + paragraphs.size()) return;
+            const int height = paragraphs.height(line - first);
+            if (!paragraphs.set(line - first, text(line))) return;
+            // A line that wrapped differently moves everything below it.
+            mark(line, paragraphs.height(line - first) == height ? line : npos);
+        }
+        // Extends the window so that it contains `line`, keeping it contiguous.
+        int height(size_t line) {
+            if (line + 1 < first || line > first + paragraphs.size()) paragraphs.erase(0, paragraphs.size());
+            if (!paragraphs.size()) {
+                first = line;
+                paragraphs.insert(0, text(line));
+            }
+            while (line < first) paragraphs.insert(0, text(--first));
+            while (line >= first + paragraphs.size()) paragraphs.insert(paragraphs.size(), text(first + paragraphs.size()));
+            return paragraphs.height(line - first);
+        }
+        // Normalizes (top, offset) so that 0 <= offset < height(top).
+        void settle() {
+            while (offset < 0 && _top > 0) offset += height(--_top);
+            if (offset < 0) offset = 0;
+            while (_top + 1 < source->lines() && offset >= height(_top)) offset -= height(_top++);
+            if (_top + 1 >= source->lines() && offset >= height(_top)) offset = 0;
+        }
+        void reveal() {
+            const size_t line = lineOf(_caret);
+            if (line < _top || (line == _top && offset > 0)) {
+                _top = line;
+                offset = 0;
+                return;
+            }
+            const int skip = font->lineSkip();
+            if (skip > 0 && (line - _top) * skip > static_cast<size_t>(viewport.height) * 2) {
+                // Far jump: anchor on the caret line and let settle() walk back up.
+                _top = line;
+                offset = static_cast<float>(height(line) - viewport.height);
+                settle();
+                return;
+            }
+            float bottom = -offset;
+            for (size_t i = _top; i <= line; i++) bottom += height(i);
+            if (bottom > viewport.height) scroll(bottom - viewport.height);
+        }
+        // Keeps exactly the lines intersecting the viewport plus `overscan` lines of margin laid out.
+        void layout() {
+            settle();
+            const size_t want = _top > overscan ? _top - overscan : 0;
+            if (want >= first + paragraphs.size()) paragraphs.erase(0, paragraphs.size());
+            else if (want > first) paragraphs.erase(0, want - first);
+            if (!paragraphs.size()) first = want;
+            else first = std::max(first, want);
+            height(want);
+
+            const float margin = static_cast<float>(overscan * font->lineSkip());
+            size_t line = _top;
+            float y = -offset;
+            while (line < source->lines() && y < viewport.height + margin) y += height(line++);
+            if (line < first + paragraphs.size()) paragraphs.erase(line - first, first + paragraphs.size() - line);
+        }
+    };
+
+    using TextView = BasicTextView<Document>;
+
+} // namespace totpad